@@ -0,0 +1,407 @@
+﻿/**
+ * \file bench_main.cpp
+ * \brief Бенчмарк горячих участков csv_median_calculator по стадиям
+ *
+ * Генерирует синтетические level/trade CSV (synthetic_data.hpp) и меряет
+ * по отдельности: токенизацию строк, разбор чисел, чтение файлов целиком,
+ * сортировку / слияние, движки медианы (add + median на каждой строке)
+ * и форматирование результата. Каждая стадия выполняется --repeat раз,
+ * в отчёт идёт лучшее время; пропускная способность — строк/с и МБ/с.
+ *
+ * Пример: csv_median_bench --rows 5000000 --files 8 --dist spiky --stage median
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <span>
+#include <filesystem>
+#include <functional>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+#include <boost/program_options.hpp>
+#include <fmt/format.h>
+
+#include "../src/csv_reader.hpp"
+#include "../src/record_store.hpp"
+#include "../src/thread_pool.hpp"
+#include "../src/simd_scan.hpp"
+#include "../src/median_calculator.hpp"
+#include "../src/exact_median.hpp"
+#include "../src/window_median.hpp"
+#include "../src/histogram_median.hpp"
+#include "../src/result_writer.hpp"
+#include "synthetic_data.hpp"
+
+namespace fs = std::filesystem;
+namespace po = boost::program_options;
+
+namespace {
+
+    struct bench_context {
+        std::size_t repeat = 3;
+        std::string filter;             ///< подстрока имени стадии; пусто — все
+        std::uint64_t checksum = 0;     ///< не даёт компилятору выбросить измеряемый код
+    };
+
+    /**
+     * \brief Выполняет fn repeat раз и печатает лучшее время.
+     * \param rows строк, обработанных за один прогон
+     * \param bytes байт, обработанных за один прогон (0 — колонка МБ/с пустая)
+     */
+    void run_stage(bench_context& ctx, std::string_view name, std::size_t rows, std::uintmax_t bytes,
+        const std::function<std::uint64_t()>& fn) {
+        if (!ctx.filter.empty() && name.find(ctx.filter) == std::string_view::npos) return;
+        double best = std::numeric_limits<double>::max();
+        for (std::size_t r = 0; r < std::max<std::size_t>(ctx.repeat, 1); ++r) {
+            const auto t0 = std::chrono::steady_clock::now();
+            ctx.checksum += fn();
+            const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+            best = std::min(best, dt.count());
+        }
+        best = std::max(best, 1e-9);
+        const std::string mbps = bytes ? fmt::format(" {:10.1f} MB/s", double(bytes) / best / 1e6) : std::string();
+        std::cout << fmt::format("{:<32} {:10.2f} ms {:12.2f} Mrows/s{}\n",
+            name, best * 1e3, double(rows) / best / 1e6, mbps);
+    }
+
+    /// Поля receive_ts и price всех строк файлов (string_view поверх отображений)
+    struct field_sample {
+        std::vector<std::string_view> lines;
+        std::vector<std::string_view> ts;
+        std::vector<std::string_view> price;
+        std::uintmax_t line_bytes = 0, ts_bytes = 0, price_bytes = 0;
+    };
+
+    void collect_fields(const std::vector<csv::mapped_file>& files, field_sample& out) {
+        std::vector<std::string_view> tokens;
+        for (const auto& f : files) {
+            auto data = f.view();
+            data.remove_prefix(std::min(data.size(), data.find('\n') + 1));  // заголовок
+            while (!data.empty()) {
+                const auto nl = std::min(data.find('\n'), data.size());
+                const auto line = data.substr(0, nl);
+                data.remove_prefix(std::min(data.size(), nl + 1));
+                csv::split_line(line, tokens);
+                if (tokens.size() < 3) continue;
+                out.lines.push_back(line);
+                out.ts.push_back(tokens[0]);
+                out.price.push_back(tokens[2]);
+                out.line_bytes += line.size() + 1;
+                out.ts_bytes += tokens[0].size();
+                out.price_bytes += tokens[2].size();
+            }
+        }
+    }
+
+    template <class Calc>
+    std::uint64_t feed_median(Calc calc, const csv::record_store& rows) {
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < rows.size(); ++i) {
+            if constexpr (requires { calc.add(rows.receive_ts[i], rows.price[i]); }) {
+                calc.add(rows.receive_ts[i], rows.price[i]);
+            }
+            else {
+                calc.add(rows.price[i]);
+            }
+            if (auto m = calc.median()) seen += static_cast<std::uint64_t>(*m);
+        }
+        return seen;
+    }
+
+    /// То же через add_batch_and_emit блоками по 64K строк, как median_emitter в main.cpp
+    template <class Calc>
+    std::uint64_t feed_median_batch(Calc calc, const csv::record_store& rows) {
+        constexpr std::size_t slice = 65536;
+        std::uint64_t seen = 0;
+        const auto sum = [&](std::size_t, double m) { seen += static_cast<std::uint64_t>(m); };
+        for (std::size_t i = 0; i < rows.size(); i += slice) {
+            const std::size_t n = std::min(slice, rows.size() - i);
+            const std::span<const double> prices(rows.price.data() + i, n);
+            if constexpr (requires { calc.add(rows.receive_ts[i], rows.price[i]); }) {
+                calc.add_batch_and_emit(std::span<const std::uint64_t>(rows.receive_ts.data() + i, n), prices, sum);
+            }
+            else {
+                calc.add_batch_and_emit(prices, sum);
+            }
+        }
+        return seen;
+    }
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    bench::gen_options gen;
+    bench_context ctx;
+    std::string dist = "walk";
+    std::string dir_arg;
+    std::size_t threads = 0;
+    bool keep = false;
+
+    po::options_description desc("csv_median_bench options");
+    desc.add_options()
+        ("help,h", "показать подсказку")
+        ("rows", po::value(&gen.rows)->default_value(gen.rows), "всего строк во всех файлах")
+        ("files", po::value(&gen.files)->default_value(gen.files), "число файлов (level / trade по очереди)")
+        ("dist", po::value(&dist)->default_value(dist), "распределение цен: walk, uniform, spiky")
+        ("gap-us", po::value(&gen.mean_gap_us)->default_value(gen.mean_gap_us), "средний интервал между событиями, мкс")
+        ("disorder", po::value(&gen.disorder)->default_value(gen.disorder), "доля строк не по порядку receive_ts")
+        ("seed", po::value(&gen.seed)->default_value(gen.seed), "seed генератора")
+        ("dir", po::value(&dir_arg), "куда писать данные (по умолчанию — временная директория)")
+        ("keep", po::bool_switch(&keep), "не удалять сгенерированные файлы")
+        ("threads", po::value(&threads)->default_value(threads), "потоки для чтения и слияния, 0 — по числу ядер")
+        ("repeat", po::value(&ctx.repeat)->default_value(ctx.repeat), "повторов каждой стадии (берётся лучший)")
+        ("stage", po::value(&ctx.filter), "только стадии, содержащие подстроку")
+        ;
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    }
+    catch (const std::exception& ex) {
+        std::cerr << ex.what() << "\n" << desc << "\n";
+        return 2;
+    }
+    if (vm.count("help")) {
+        std::cout << desc << "\n";
+        return 0;
+    }
+    if (auto d = bench::parse_dist(dist)) {
+        gen.dist = *d;
+    }
+    else {
+        std::cerr << "Неизвестное распределение: " << dist << "\n";
+        return 2;
+    }
+
+    // ---- Данные ----
+    const fs::path dir = dir_arg.empty() ? fs::temp_directory_path() / "csv_median_bench" : fs::path(dir_arg);
+    const auto t0 = std::chrono::steady_clock::now();
+    auto generated = bench::generate(dir, gen);
+    if (!generated) {
+        std::cerr << "Не удалось записать данные в " << dir.string() << "\n";
+        return 3;
+    }
+    const std::chrono::duration<double> gen_time = std::chrono::steady_clock::now() - t0;
+    std::cout << fmt::format("Данные: {} файлов, {} строк, {:.1f} МБ в {} (генерация {:.2f} с)\n",
+        generated->paths.size(), gen.rows, double(generated->bytes) / 1e6, dir.string(), gen_time.count());
+    std::cout << fmt::format("Сканер: {}, потоков: {}\n\n",
+        csv::simd::isa_name(csv::simd::active_isa()), threads == 0 ? par::default_thread_count() : threads);
+
+    std::vector<csv::mapped_file> files(generated->paths.size());
+    for (std::size_t i = 0; i < files.size(); ++i) {
+        if (auto err = files[i].open(generated->paths[i])) {
+            std::cerr << *err << "\n";
+            return 3;
+        }
+    }
+    field_sample sample;
+    collect_fields(files, sample);
+    const std::size_t n = sample.lines.size();
+
+    // ---- Токенизация ----
+    run_stage(ctx, "tokenize/split_line(string)", n, sample.line_bytes, [&] {
+        std::uint64_t k = 0;
+        std::string line;
+        for (auto l : sample.lines) {
+            line.assign(l);
+            k += csv::split_line(line).size();
+        }
+        return k;
+    });
+    run_stage(ctx, "tokenize/split_line(view)", n, sample.line_bytes, [&] {
+        std::uint64_t k = 0;
+        std::vector<std::string_view> tokens;
+        for (auto l : sample.lines) {
+            csv::split_line(l, tokens);
+            k += tokens.size();
+        }
+        return k;
+    });
+    const auto saved_isa = csv::simd::active_isa();
+    for (auto v : { csv::simd::isa::scalar, csv::simd::isa::sse2, csv::simd::isa::avx2, csv::simd::isa::neon }) {
+        if (!csv::simd::force_isa(v)) continue;
+        run_stage(ctx, fmt::format("tokenize/block_cursor({})", csv::simd::isa_name(v)), n, generated->bytes, [&] {
+            std::uint64_t k = 0;
+            for (const auto& f : files) {
+                csv::simd::block_cursor cur(f.view(), ';');
+                for (std::size_t p = cur.next_any(0); p < f.size(); p = cur.next_any(p + 1)) ++k;
+            }
+            return k;
+        });
+    }
+    csv::simd::force_isa(saved_isa);
+
+    // ---- Разбор чисел ----
+    run_stage(ctx, "parse/parse_u64", n, sample.ts_bytes, [&] {
+        std::uint64_t k = 0, v = 0;
+        for (auto s : sample.ts) k += csv::parse_u64(s, v) ? v : 0;
+        return k;
+    });
+    run_stage(ctx, "parse/parse_long_double", n, sample.price_bytes, [&] {
+        std::uint64_t k = 0;
+        long double v = 0;
+        for (auto s : sample.price) k += csv::parse_long_double(s, v) ? static_cast<std::uint64_t>(v) : 0;
+        return k;
+    });
+    run_stage(ctx, "parse/parse_double", n, sample.price_bytes, [&] {
+        std::uint64_t k = 0;
+        double v = 0;
+        for (auto s : sample.price) k += csv::parse_double(s, v) ? static_cast<std::uint64_t>(v) : 0;
+        return k;
+    });
+    run_stage(ctx, "parse/parse_fixed_price", n, sample.price_bytes, [&] {
+        std::uint64_t k = 0;
+        std::int64_t v = 0;
+        for (auto s : sample.price) k += csv::parse_fixed_price(s, v) ? static_cast<std::uint64_t>(v) : 0;
+        return k;
+    });
+    sample = {};
+    files.clear();
+
+    // ---- Чтение файлов целиком ----
+    par::thread_pool pool(threads);
+    par::thread_pool serial(1);
+    csv::record_store records;
+    run_stage(ctx, "read/read_csv_paths(1 thread)", n, generated->bytes, [&] {
+        csv::record_store s;
+        if (auto err = csv::read_csv_paths(generated->paths, s, serial)) std::cerr << *err << "\n";
+        return static_cast<std::uint64_t>(s.size());
+    });
+    // файлы уже в кэше страниц: стадия показывает накладные расходы упреждающего чтения, а не выигрыш на сети
+    run_stage(ctx, "read/read_csv_paths(1 thread, no read-ahead)", n, generated->bytes, [&] {
+        csv::record_store s;
+        csv::read_options options;
+        options.read_ahead_bytes = 0;
+        if (auto err = csv::read_csv_paths(generated->paths, s, serial, options)) std::cerr << *err << "\n";
+        return static_cast<std::uint64_t>(s.size());
+    });
+    if (pool.size() > 1) {
+        run_stage(ctx, fmt::format("read/read_csv_paths({} threads)", pool.size()), n, generated->bytes, [&] {
+            csv::record_store s;
+            if (auto err = csv::read_csv_paths(generated->paths, s, pool)) std::cerr << *err << "\n";
+            return static_cast<std::uint64_t>(s.size());
+        });
+    }
+    if (auto err = csv::read_csv_paths(generated->paths, records, pool)) {
+        std::cerr << *err << "\n";
+        return 3;
+    }
+
+    // ---- Сортировка / слияние ----
+    // сортировка сравнением — ориентир для радикс-сортировки sort_by_time
+    run_stage(ctx, "sort/std::sort(index)", records.size(), 0, [&] {
+        auto r = records;
+        std::vector<csv::row_index_t> order(r.size());
+        std::iota(order.begin(), order.end(), csv::row_index_t(0));
+        std::sort(order.begin(), order.end(), [&](csv::row_index_t a, csv::row_index_t b) {
+            if (r.receive_ts[a] != r.receive_ts[b]) return r.receive_ts[a] < r.receive_ts[b];
+            if (r.file_id[a] != r.file_id[b]) return r.file_id[a] < r.file_id[b];
+            return r.line_no[a] < r.line_no[b];
+        });
+        r.apply_order(order);
+        return r.receive_ts.back();
+    });
+    run_stage(ctx, "sort/sort_by_time(1 thread)", records.size(), 0, [&] {
+        auto s = records;
+        s.sort_by_time(serial);
+        return s.receive_ts.back();
+    });
+    if (pool.size() > 1) {
+        run_stage(ctx, fmt::format("sort/sort_by_time({} threads)", pool.size()), records.size(), 0, [&] {
+            auto s = records;
+            s.sort_by_time(pool);
+            return s.receive_ts.back();
+        });
+    }
+    run_stage(ctx, "sort/merge_by_time", records.size(), 0, [&] {
+        auto s = records;
+        s.merge_by_time(pool);
+        return s.receive_ts.back();
+    });
+    records.merge_by_time(pool);
+
+    // ---- Движки медианы: add + median на каждой строке ----
+    run_stage(ctx, "median/psquare", records.size(), 0, [&] {
+        return feed_median(median::basic_median_calculator<double>(64), records);
+    });
+    run_stage(ctx, "median/psquare(batch)", records.size(), 0, [&] {
+        return feed_median_batch(median::basic_median_calculator<double>(64), records);
+    });
+    run_stage(ctx, "median/exact", records.size(), 0, [&] {
+        return feed_median(median::exact_median_calculator<double>{}, records);
+    });
+    run_stage(ctx, "median/exact(batch)", records.size(), 0, [&] {
+        return feed_median_batch(median::exact_median_calculator<double>{}, records);
+    });
+    run_stage(ctx, "median/histogram(tick)", records.size(), 0, [&] {
+        return feed_median(median::histogram_median_calculator<double>(gen.tick), records);
+    });
+    run_stage(ctx, "median/window(1s)", records.size(), 0, [&] {
+        return feed_median(median::window_median_calculator<double>(median::window_spec{ 1'000'000, 0 }), records);
+    });
+    run_stage(ctx, "median/window(1000 ticks)", records.size(), 0, [&] {
+        return feed_median(median::window_median_calculator<double>(median::window_spec{ 0, 1000 }), records);
+    });
+
+    // ---- Запись результата: каждая цена форматируется и пишется строкой ----
+    // первый проход — только чтобы узнать объём вывода для МБ/с
+    const fs::path out_path = dir / "bench_output.csv";
+    std::uintmax_t out_bytes = 0;
+    {
+        std::ofstream ofs(out_path, std::ios::out | std::ios::trunc | std::ios::binary);
+        out::block_writer w(ofs);
+        out::change_detector<double> last;
+        for (std::size_t i = 0; i < records.size(); ++i) {
+            last.update(records.price[i]);
+            out::append_row(w.buffer(), records.receive_ts[i], last.text());
+            w.maybe_flush();
+        }
+        w.flush();
+        std::error_code ec;
+        out_bytes = fs::file_size(out_path, ec);
+    }
+    run_stage(ctx, "write/format+block_writer", records.size(), out_bytes, [&] {
+        std::ofstream ofs(out_path, std::ios::out | std::ios::trunc | std::ios::binary);
+        out::block_writer w(ofs);
+        out::change_detector<double> last;
+        std::uint64_t k = 0;
+        for (std::size_t i = 0; i < records.size(); ++i) {
+            k += last.update(records.price[i]);
+            out::append_row(w.buffer(), records.receive_ts[i], last.text());
+            w.maybe_flush();
+        }
+        w.flush();
+        return k;
+    });
+    // те же строки в двоичном формате: число не форматируется, запись — 16 байт
+    const fs::path bin_path = dir / "bench_output.bin";
+    run_stage(ctx, "write/binary+block_writer", records.size(), records.size() * 16, [&] {
+        std::ofstream ofs(bin_path, std::ios::out | std::ios::trunc | std::ios::binary);
+        out::block_writer w(ofs);
+        w.buffer() = out::make_binary_header<double>({}, false);
+        for (std::size_t i = 0; i < records.size(); ++i) {
+            out::append_binary_row(w.buffer(), records.receive_ts[i], records.price[i]);
+            w.maybe_flush();
+        }
+        w.flush();
+        return static_cast<std::uint64_t>(records.size());
+    });
+
+    std::cout << fmt::format("\nchecksum {}\n", ctx.checksum);
+    if (!keep) {
+        std::error_code ec;
+        for (const auto& p : generated->paths) fs::remove(p, ec);
+        fs::remove(out_path, ec);
+        fs::remove(bin_path, ec);
+        if (dir_arg.empty()) fs::remove(dir, ec);
+    }
+    return 0;
+}
@@ -0,0 +1,167 @@
+﻿#pragma once
+/**
+ * \file synthetic_data.hpp
+ * \brief Генератор синтетических CSV в формате level / trade
+ *
+ * Файлы повторяют колонки examples/input: level — receive_ts;exchange_ts;price;
+ * quantity;side;rebuild, trade — receive_ts;exchange_ts;price;quantity;side.
+ * Файлы покрывают один и тот же интервал времени, строки внутри файла
+ * упорядочены по receive_ts, если не задана доля перестановок (disorder).
+ * Результат детерминирован при одинаковых параметрах и seed.
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#include "../src/result_writer.hpp"
+
+namespace bench {
+
+    /// Распределение цен
+    enum class price_dist {
+        walk,     ///< случайное блуждание по тикам
+        uniform,  ///< равномерно в коридоре ±5% от base_price
+        spiky,    ///< блуждание с редкими скачками ±2%
+    };
+
+    inline std::optional<price_dist> parse_dist(std::string_view s) {
+        if (s == "walk") return price_dist::walk;
+        if (s == "uniform") return price_dist::uniform;
+        if (s == "spiky") return price_dist::spiky;
+        return std::nullopt;
+    }
+
+    struct gen_options {
+        std::size_t rows = 2'000'000;        ///< всего строк во всех файлах
+        std::size_t files = 4;               ///< чётные — level_<i>.csv, нечётные — trade_<i>.csv
+        price_dist dist = price_dist::walk;
+        double base_price = 68480.0;
+        double tick = 0.1;
+        std::uint64_t start_ts = 1716810808000000;
+        double mean_gap_us = 50.0;           ///< средний интервал между событиями файла, мкс
+        double disorder = 0.0;               ///< доля строк, переставленных с соседней
+        std::uint64_t seed = 42;
+    };
+
+    /// Созданные файлы (в порядке file_id) и их общий размер
+    struct gen_result {
+        std::vector<std::filesystem::path> paths;
+        std::uintmax_t bytes = 0;
+    };
+
+    namespace detail {
+        inline void append_u64(std::string& text, std::uint64_t v) {
+            char buf[out::max_u64_chars];
+            text.append(buf, std::to_chars(buf, buf + sizeof(buf), v).ptr);
+        }
+
+        inline void append_price(std::string& text, double v) {
+            char buf[out::max_price_chars];
+            text.append(buf, out::format_price(buf, buf + sizeof(buf), v));
+        }
+
+        struct row_t {
+            std::uint64_t ts;
+            double price;
+            double qty;
+            bool bid;
+        };
+    }  // namespace detail
+
+    /**
+     * \brief Пишет opt.files файлов в dir (директория создаётся).
+     * \return std::nullopt при ошибке записи
+     */
+    inline std::optional<gen_result> generate(const std::filesystem::path& dir, const gen_options& opt) {
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        if (ec) return std::nullopt;
+
+        gen_result result;
+        const std::size_t files = std::max<std::size_t>(opt.files, 1);
+        std::mt19937_64 rng(opt.seed);
+        std::exponential_distribution<double> gap(1.0 / std::max(opt.mean_gap_us, 1e-3));
+        std::normal_distribution<double> step(0.0, 1.0);
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        std::geometric_distribution<int> burst(0.35);  // строк level на одно событие: в среднем ~3
+
+        std::vector<detail::row_t> rows;
+        std::string text;
+        for (std::size_t f = 0; f < files; ++f) {
+            const bool level = f % 2 == 0;
+            const std::size_t n = opt.rows / files + (f < opt.rows % files ? 1 : 0);
+            rows.clear();
+            rows.reserve(n);
+            double ts = static_cast<double>(opt.start_ts);
+            double mid = opt.base_price;
+            while (rows.size() < n) {
+                ts += level ? gap(rng) : gap(rng) * 4;
+                switch (opt.dist) {
+                case price_dist::walk:
+                    mid += std::round(step(rng)) * opt.tick;
+                    break;
+                case price_dist::spiky:
+                    mid += std::round(step(rng)) * opt.tick;
+                    if (unit(rng) < 1e-4) mid *= unit(rng) < 0.5 ? 0.98 : 1.02;
+                    break;
+                case price_dist::uniform:
+                    mid = opt.base_price * (0.95 + 0.1 * unit(rng));
+                    break;
+                }
+                mid = std::max(mid, opt.tick);
+                const int k = level ? 1 + burst(rng) : 1;
+                for (int j = 0; j < k && rows.size() < n; ++j) {
+                    const bool bid = unit(rng) < 0.5;
+                    const double px = std::round(mid / opt.tick) * opt.tick + (bid ? -j : j) * opt.tick;
+                    rows.push_back({ static_cast<std::uint64_t>(ts), px,
+                        std::round(unit(rng) * 10.0 * 1e3) / 1e3, bid });
+                }
+            }
+            for (std::size_t i = 0; i + 1 < rows.size(); ++i) {
+                if (opt.disorder > 0 && unit(rng) < opt.disorder) std::swap(rows[i], rows[i + 1]);
+            }
+
+            const auto path = dir / ((level ? "level_" : "trade_") + std::to_string(f) + ".csv");
+            std::ofstream ofs(path, std::ios::out | std::ios::trunc | std::ios::binary);
+            if (!ofs) return std::nullopt;
+            ofs << (level ? "receive_ts;exchange_ts;price;quantity;side;rebuild\n"
+                          : "receive_ts;exchange_ts;price;quantity;side\n");
+            text.clear();
+            for (std::size_t i = 0; i < rows.size(); ++i) {
+                const auto& r = rows[i];
+                detail::append_u64(text, r.ts);
+                text += ';';
+                detail::append_u64(text, r.ts - std::min<std::uint64_t>(r.ts, 1000 + r.ts % 20000));
+                text += ';';
+                detail::append_price(text, r.price);
+                text += ';';
+                detail::append_price(text, r.qty);
+                text += r.bid ? ";bid" : ";ask";
+                if (level) text += i == 0 ? ";1" : ";0";
+                text += '\n';
+                if (text.size() >= (std::size_t(1) << 20)) {
+                    ofs.write(text.data(), static_cast<std::streamsize>(text.size()));
+                    text.clear();
+                }
+            }
+            ofs.write(text.data(), static_cast<std::streamsize>(text.size()));
+            if (!ofs.flush()) return std::nullopt;
+            result.bytes += std::filesystem::file_size(path, ec);
+            result.paths.push_back(path);
+        }
+        std::sort(result.paths.begin(), result.paths.end(),
+            [](const auto& a, const auto& b) { return a.string() < b.string(); });
+        return result;
+    }
+
+}  // namespace bench
@@ -0,0 +1,251 @@
+﻿#pragma once
+/**
+ * \file checkpoint.hpp
+ * \brief Контрольная точка для инкрементальных запусков
+ *
+ * Файл хранит, докуда разобран каждый входной файл (смещение и номер строки),
+ * последний обработанный receive_ts и состояние расчёта: калькулятор медианы
+ * (буфер / маркеры P^2 / кучи / окно), статистики и последнюю записанную строку.
+ * Повторный запуск разбирает только дописанные байты и дописывает в результат
+ * только новые строки.
+ *
+ * Формат — двоичный, в порядке байт машины: сигнатура, версия, отпечаток
+ * конфигурации, затем поля в порядке serialize_state. Архивы writer/reader
+ * совместимы с методом serialize(Archive&, unsigned) аккумуляторов Boost,
+ * поэтому состояние P^2 сохраняется без доступа к закрытым полям.
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <utility>
+#include <system_error>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+#include <boost/array.hpp>
+
+namespace ckpt {
+
+    inline constexpr std::string_view magic = "CSVMCKPT";
+    inline constexpr std::uint32_t version = 1;
+
+    /// Архив записи: operator& дописывает значение в буфер
+    class writer {
+    public:
+        static constexpr bool is_loading = false;
+
+        template <class T>
+        writer& operator&(const T& v) {
+            put(v);
+            return *this;
+        }
+
+        /// Типы с методом serialize_state(Archive&) (он же используется для чтения)
+        template <class T>
+            requires requires(T& t, writer& w) { t.serialize_state(w); }
+        writer& operator&(const T& v) {
+            const_cast<T&>(v).serialize_state(*this);
+            return *this;
+        }
+
+        const std::string& data() const noexcept { return _buf; }
+
+    private:
+        template <class T>
+        void put(const T& v) {
+            static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>, "unsupported checkpoint field type");
+            _buf.append(reinterpret_cast<const char*>(&v), sizeof(T));
+        }
+
+        void put(const std::string& s) {
+            put(static_cast<std::uint64_t>(s.size()));
+            _buf.append(s);
+        }
+
+        template <class T, std::size_t N>
+        void put(const boost::array<T, N>& a) {
+            for (const auto& v : a) put(v);
+        }
+
+        template <class T>
+        void put(const std::vector<T>& v) { put_range(v); }
+
+        template <class T>
+        void put(const std::deque<T>& v) { put_range(v); }
+
+        template <class A, class B>
+        void put(const std::pair<A, B>& p) {
+            put(p.first);
+            put(p.second);
+        }
+
+        template <class R>
+        void put_range(const R& r) {
+            put(static_cast<std::uint64_t>(r.size()));
+            for (const auto& v : r) *this & v;
+        }
+
+    private:
+        std::string _buf;
+    };
+
+    /// Архив чтения: operator& читает значение; при нехватке данных ok() == false
+    class reader {
+    public:
+        static constexpr bool is_loading = true;
+
+        explicit reader(std::string data) : _data(std::move(data)) {}
+
+        template <class T>
+        reader& operator&(T& v) {
+            get(v);
+            return *this;
+        }
+
+        template <class T>
+            requires requires(T& t, reader& r) { t.serialize_state(r); }
+        reader& operator&(T& v) {
+            v.serialize_state(*this);
+            return *this;
+        }
+
+        bool ok() const noexcept { return _ok; }
+        bool at_end() const noexcept { return _pos == _data.size(); }
+
+    private:
+        template <class T>
+        void get(T& v) {
+            static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>, "unsupported checkpoint field type");
+            if (!take(sizeof(T))) return;
+            std::memcpy(&v, _data.data() + _pos - sizeof(T), sizeof(T));
+        }
+
+        void get(std::string& s) {
+            std::uint64_t n = 0;
+            get(n);
+            if (!take(n)) return;
+            s.assign(_data.data() + _pos - n, n);
+        }
+
+        template <class T, std::size_t N>
+        void get(boost::array<T, N>& a) {
+            for (auto& v : a) get(v);
+        }
+
+        template <class T>
+        void get(std::vector<T>& v) { get_range(v); }
+
+        template <class T>
+        void get(std::deque<T>& v) { get_range(v); }
+
+        template <class A, class B>
+        void get(std::pair<A, B>& p) {
+            get(p.first);
+            get(p.second);
+        }
+
+        template <class R>
+        void get_range(R& r) {
+            std::uint64_t n = 0;
+            get(n);
+            r.clear();
+            // каждый элемент занимает хотя бы байт — защита от испорченного размера
+            if (!_ok || n > _data.size() - _pos) {
+                _ok = false;
+                return;
+            }
+            for (std::uint64_t i = 0; i < n && _ok; ++i) {
+                typename R::value_type v{};
+                *this & v;
+                r.push_back(std::move(v));
+            }
+        }
+
+        bool take(std::uint64_t n) {
+            if (!_ok || n > _data.size() - _pos) {
+                _ok = false;
+                return false;
+            }
+            _pos += static_cast<std::size_t>(n);
+            return true;
+        }
+
+    private:
+        std::string _data;
+        std::size_t _pos = 0;
+        bool _ok = true;
+    };
+
+    /// Докуда разобран входной файл
+    struct file_cursor {
+        std::string path;
+        std::uint64_t offset = 0;  ///< начало первой неразобранной строки; 0 — файл ещё не читался
+        std::uint64_t line = 0;    ///< сколько строк (включая заголовок) до offset
+
+        template <class Archive>
+        void serialize_state(Archive& ar) {
+            ar & path & offset & line;
+        }
+    };
+
+    /**
+     * \brief Записывает контрольную точку: сигнатура, версия, отпечаток конфигурации, состояние.
+     *
+     * Запись идёт во временный файл, который затем переименовывается, — прерванный
+     * запуск не оставляет испорченную контрольную точку.
+     * \return std::nullopt при успехе, иначе описание ошибки
+     */
+    inline std::optional<std::string> save_file(const std::filesystem::path& path, std::string_view fingerprint,
+        const writer& state) {
+        writer header;
+        header & version & std::string(fingerprint);
+        const auto tmp = std::filesystem::path(path.string() + ".tmp");
+        {
+            std::ofstream ofs(tmp, std::ios::out | std::ios::trunc | std::ios::binary);
+            if (!ofs) return std::string("Не удалось записать контрольную точку: ") + tmp.string();
+            ofs.write(magic.data(), static_cast<std::streamsize>(magic.size()));
+            ofs.write(header.data().data(), static_cast<std::streamsize>(header.data().size()));
+            ofs.write(state.data().data(), static_cast<std::streamsize>(state.data().size()));
+            if (!ofs.flush()) return std::string("Не удалось записать контрольную точку: ") + tmp.string();
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        if (ec) return std::string("Не удалось записать контрольную точку: ") + path.string() + ": " + ec.message();
+        return std::nullopt;
+    }
+
+    /**
+     * \brief Читает контрольную точку и проверяет сигнатуру, версию и отпечаток конфигурации.
+     * \param out архив, установленный на начало состояния
+     * \return std::nullopt при успехе, иначе описание ошибки
+     */
+    inline std::optional<std::string> load_file(const std::filesystem::path& path, std::string_view fingerprint,
+        std::optional<reader>& out) {
+        std::ifstream ifs(path, std::ios::in | std::ios::binary);
+        if (!ifs) return std::string("Не удалось открыть контрольную точку: ") + path.string();
+        std::string data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        if (data.compare(0, magic.size(), magic) != 0) {
+            return std::string("Файл не является контрольной точкой: ") + path.string();
+        }
+        out.emplace(data.substr(magic.size()));
+        std::uint32_t ver = 0;
+        std::string stored;
+        *out & ver & stored;
+        if (!out->ok() || ver != version) {
+            return std::string("Неподдерживаемая версия контрольной точки: ") + path.string();
+        }
+        if (stored != fingerprint) {
+            return std::string("Контрольная точка создана с другими настройками расчёта: ") + path.string();
+        }
+        return std::nullopt;
+    }
+
+}  // namespace ckpt
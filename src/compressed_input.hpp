@@ -0,0 +1,305 @@
+﻿#pragma once
+/**
+ * \file compressed_input.hpp
+ * \brief Потоковая распаковка входных файлов .csv.gz и .csv.zst
+ *
+ * Сжатый файл отображается в память целиком, текст распаковывается блоками
+ * (~block_bytes) в буфер процесса: на диск ничего не пишется, в памяти
+ * одновременно живёт только текущий блок. Блок всегда состоит из целых строк —
+ * хвост недочитанной строки переносится в начало следующего блока, — поэтому
+ * блоки разбираются тем же parse_rows, что и отображённые .csv.
+ *
+ * gzip поддерживается при сборке с zlib (CSV_WITH_ZLIB), zstd — с libzstd
+ * (CSV_WITH_ZSTD); без библиотеки такие файлы находятся, но открытие
+ * завершается понятной ошибкой. Несколько склеенных gzip-членов или
+ * zstd-кадров читаются подряд, как делают gzip -d и zstd -d.
+ */
+
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <optional>
+#include <algorithm>
+#include <limits>
+#include <cctype>
+#include <cstdint>
+#include <cstddef>
+
+#include "mapped_file.hpp"
+
+#if defined(CSV_WITH_ZLIB)
+#include <zlib.h>
+#endif
+#if defined(CSV_WITH_ZSTD)
+#include <zstd.h>
+#endif
+
+namespace csv::codec {
+
+    enum class compression { none, gzip, zstd };
+
+    namespace detail {
+        inline bool ends_with_nocase(std::string_view s, std::string_view suffix) {
+            if (s.size() < suffix.size()) return false;
+            return std::equal(suffix.begin(), suffix.end(), s.end() - suffix.size(), [](char a, char b) {
+                return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+            });
+        }
+    }  // namespace detail
+
+    /// Сжатие по расширению имени: .gz — gzip, .zst — zstd (регистр игнорируется)
+    inline compression compression_of(const std::filesystem::path& path) {
+        const auto name = path.filename().string();
+        if (detail::ends_with_nocase(name, ".gz")) return compression::gzip;
+        if (detail::ends_with_nocase(name, ".zst")) return compression::zstd;
+        return compression::none;
+    }
+
+    /// Входной CSV: .csv, .csv.gz или .csv.zst
+    inline bool is_csv_name(const std::filesystem::path& path) {
+        const auto name = path.filename().string();
+        return detail::ends_with_nocase(name, ".csv") || detail::ends_with_nocase(name, ".csv.gz")
+            || detail::ends_with_nocase(name, ".csv.zst");
+    }
+
+    /// Имя без расширения и без суффикса сжатия: level.csv.gz → level
+    inline std::string csv_stem(const std::filesystem::path& path) {
+        auto name = path.filename();
+        if (compression_of(name) != compression::none) name = name.stem();
+        return name.stem().string();
+    }
+
+    inline const char* name_of(compression c) {
+        switch (c) {
+        case compression::gzip: return "gzip";
+        case compression::zstd: return "zstd";
+        default: return "none";
+        }
+    }
+
+    /// Собрана ли программа с поддержкой c
+    inline bool available(compression c) {
+        switch (c) {
+        case compression::none: return true;
+#if defined(CSV_WITH_ZLIB)
+        case compression::gzip: return true;
+#endif
+#if defined(CSV_WITH_ZSTD)
+        case compression::zstd: return true;
+#endif
+        default: return false;
+        }
+    }
+
+    /**
+     * \brief Читает распакованный текст сжатого файла блоками целых строк.
+     *
+     * Блок, на который указывает next(), действителен до следующего вызова next().
+     */
+    class compressed_reader {
+    public:
+        static constexpr std::size_t default_block_bytes = std::size_t(4) << 20;
+
+        compressed_reader() = default;
+        ~compressed_reader() { close(); }
+
+        compressed_reader(const compressed_reader&) = delete;
+        compressed_reader& operator=(const compressed_reader&) = delete;
+
+        /**
+         * \brief Отображает сжатый файл и готовит распаковщик.
+         * \return std::nullopt при успехе, иначе строка с описанием ошибки
+         */
+        std::optional<std::string> open(const std::filesystem::path& path,
+            std::size_t block_bytes = default_block_bytes) {
+            close();
+            _path = path.string();
+            _kind = compression_of(path);
+            if (!available(_kind)) {
+                return std::string("Файл сжат ") + name_of(_kind) + ", но программа собрана без его поддержки: " + _path;
+            }
+            if (auto err = _file.open(path)) return err;
+            _ahead = read_ahead(_ahead.window());
+            _ahead.advance(_file, 0);
+            _block_bytes = std::max<std::size_t>(block_bytes, 1);
+            _eof = _file.size() == 0;  // пустой сжатый файл — как пустой CSV
+#if defined(CSV_WITH_ZLIB)
+            if (_kind == compression::gzip) {
+                _z = z_stream{};
+                // 15 + 32: окно 32 КБ, заголовок gzip или zlib определяется автоматически
+                if (inflateInit2(&_z, 15 + 32) != Z_OK) return std::string("Не удалось инициализировать zlib");
+                _z_open = true;
+            }
+#endif
+#if defined(CSV_WITH_ZSTD)
+            if (_kind == compression::zstd) {
+                _zd = ZSTD_createDCtx();
+                if (!_zd) return std::string("Не удалось инициализировать zstd");
+            }
+#endif
+            return std::nullopt;
+        }
+
+        /**
+         * \brief Следующий блок текста из целых строк (последний может не кончаться '\n').
+         * \param block пустой — данные закончились
+         * \return std::nullopt при успехе, иначе строка с описанием ошибки (повреждённый или обрезанный файл)
+         */
+        std::optional<std::string> next(std::string_view& block) {
+            // перенос хвоста недочитанной строки в начало буфера
+            if (_used != 0) {
+                std::copy(_buf.begin() + static_cast<std::ptrdiff_t>(_used),
+                    _buf.begin() + static_cast<std::ptrdiff_t>(_size), _buf.begin());
+                _size -= _used;
+                _used = 0;
+            }
+            bool has_newline = std::string_view(_buf.data(), _size).find('\n') != std::string_view::npos;
+            while (!_eof && !(has_newline && _size >= _block_bytes)) {
+                // длинная строка не помещается в блок — буфер растёт
+                if (_buf.size() < _size + _block_bytes) _buf.resize(_size + _block_bytes);
+                std::size_t produced = 0;
+                if (auto err = inflate_into(_buf.data() + _size, _buf.size() - _size, produced)) return err;
+                has_newline = has_newline
+                    || std::string_view(_buf.data() + _size, produced).find('\n') != std::string_view::npos;
+                _size += produced;
+                _text_bytes += produced;
+            }
+            _used = _eof ? _size : std::string_view(_buf.data(), _size).rfind('\n') + 1;
+            block = std::string_view(_buf.data(), _used);
+            return std::nullopt;
+        }
+
+        /// Окно упреждающего чтения сжатого файла (см. read_ahead), действует со следующего open(); 0 — выключено
+        void set_read_ahead(std::size_t window) noexcept { _ahead = read_ahead(window); }
+
+        /// Размер сжатого файла, байт
+        std::uint64_t source_size() const noexcept { return _file.size(); }
+
+        /// Сколько сжатых байт распаковщик уже прочитал
+        std::uint64_t source_consumed() const noexcept {
+#if defined(CSV_WITH_ZLIB)
+            if (_kind == compression::gzip) return _in_pos - _z.avail_in;
+#endif
+            return _in_pos;
+        }
+
+        /// Сколько байт текста распаковано
+        std::uint64_t text_bytes() const noexcept { return _text_bytes; }
+
+        void close() noexcept {
+#if defined(CSV_WITH_ZLIB)
+            if (_z_open) inflateEnd(&_z);
+            _z_open = false;
+            _z_member_open = false;
+#endif
+#if defined(CSV_WITH_ZSTD)
+            if (_zd) ZSTD_freeDCtx(_zd);
+            _zd = nullptr;
+            _frame_open = false;
+#endif
+            _file.close();
+            _in_pos = 0;
+            _size = _used = 0;
+            _text_bytes = 0;
+            _eof = false;
+        }
+
+    private:
+        /// Распаковывает до cap байт в out; при исчерпании входа выставляет _eof
+        std::optional<std::string> inflate_into(char* out, std::size_t cap, std::size_t& produced) {
+            const auto in = _file.view();
+            produced = 0;
+#if defined(CSV_WITH_ZLIB)
+            if (_kind == compression::gzip) {
+                _z.next_out = reinterpret_cast<Bytef*>(out);
+                _z.avail_out = static_cast<uInt>(std::min<std::size_t>(cap, std::numeric_limits<uInt>::max()));
+                const uInt avail = _z.avail_out;
+                while (_z.avail_out != 0) {
+                    if (_z.avail_in == 0) {
+                        if (_in_pos >= in.size()) {
+                            if (_z_member_open) return truncated();
+                            _eof = true;
+                            break;
+                        }
+                        const std::size_t n = std::min<std::size_t>(in.size() - _in_pos, std::size_t(1) << 30);
+                        _z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data() + _in_pos));
+                        _z.avail_in = static_cast<uInt>(n);
+                        _in_pos += n;
+                    }
+                    _z_member_open = true;
+                    const int rc = inflate(&_z, Z_NO_FLUSH);
+                    if (rc == Z_STREAM_END) {
+                        // следующий gzip-член, если вход не закончился
+                        _z_member_open = false;
+                        if (inflateReset(&_z) != Z_OK) return corrupt("zlib");
+                    }
+                    else if (rc != Z_OK && rc != Z_BUF_ERROR) {
+                        return corrupt(_z.msg ? _z.msg : "zlib");
+                    }
+                }
+                produced = avail - _z.avail_out;
+                _file.discard_before(_in_pos - _z.avail_in);
+                _ahead.advance(_file, _in_pos - _z.avail_in);
+                return std::nullopt;
+            }
+#endif
+#if defined(CSV_WITH_ZSTD)
+            if (_kind == compression::zstd) {
+                ZSTD_inBuffer src{ in.data(), in.size(), _in_pos };
+                ZSTD_outBuffer dst{ out, cap, 0 };
+                while (dst.pos < dst.size) {
+                    if (src.pos >= src.size) {
+                        if (_frame_open) return truncated();
+                        _eof = true;
+                        break;
+                    }
+                    const std::size_t rc = ZSTD_decompressStream(_zd, &dst, &src);
+                    if (ZSTD_isError(rc)) return corrupt(ZSTD_getErrorName(rc));
+                    _frame_open = rc != 0;  // 0 — кадр распакован полностью
+                }
+                _in_pos = src.pos;
+                produced = dst.pos;
+                _file.discard_before(_in_pos);
+                _ahead.advance(_file, _in_pos);
+                return std::nullopt;
+            }
+#endif
+            (void)in;
+            (void)out;
+            (void)cap;
+            _eof = true;
+            return std::nullopt;
+        }
+
+        std::optional<std::string> truncated() const {
+            return std::string("Сжатый файл обрезан: ") + _path;
+        }
+
+        std::optional<std::string> corrupt(const char* what) const {
+            return std::string("Сжатый файл повреждён (") + what + "): " + _path;
+        }
+
+    private:
+        std::string _path;
+        compression _kind = compression::none;
+        mapped_file _file;
+        read_ahead _ahead;
+        std::size_t _in_pos = 0;       ///< сколько сжатых байт отдано распаковщику
+        std::string _buf;              ///< распакованный текст: [0, _used) — отданный блок, [_used, _size) — хвост
+        std::size_t _size = 0;
+        std::size_t _used = 0;
+        std::size_t _block_bytes = default_block_bytes;
+        std::uint64_t _text_bytes = 0;
+        bool _eof = false;
+#if defined(CSV_WITH_ZLIB)
+        z_stream _z{};
+        bool _z_open = false;
+        bool _z_member_open = false;   ///< начат gzip-член, конец которого ещё не встречен
+#endif
+#if defined(CSV_WITH_ZSTD)
+        ZSTD_DCtx* _zd = nullptr;
+        bool _frame_open = false;      ///< начат zstd-кадр, конец которого ещё не встречен
+#endif
+    };
+
+}  // namespace csv::codec
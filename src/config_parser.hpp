@@ -3,24 +3,162 @@
  * \file config_parser.hpp
  * \brief Парсинг конфигурации в формате TOML
  *
- * Функции помогают прочитать секцию [main] и заполнить структуру cfg::main_config_t.
+ * Функции помогают прочитать секции [main], [median], [group], [stats] и [follow] и заполнить структуру cfg::main_config_t.
  */
 
 #include <string>
 #include <vector>
 #include <filesystem>
 #include <optional>
+#include <regex>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
 
 #include <toml++/toml.h>
 
 namespace cfg {
 
+    /// Представление цен при чтении и расчёте
+    enum class price_format_t {
+        floating,  ///< double
+        fixed,     ///< int64 с 8 знаками после точки (csv::price_scale)
+    };
+
+    /// Способ упорядочивания записей по receive_ts
+    enum class sort_strategy_t {
+        merge,  ///< k-way слияние файлов, неупорядоченные файлы сортируются по отдельности
+        full,   ///< одна общая сортировка
+    };
+
+    /// Когда писать строку результата
+    enum class emit_mode_t {
+        row,        ///< после каждой строки, изменившей медиану
+        timestamp,  ///< после всех строк с одним receive_ts: не больше строки на метку
+    };
+
+    /// Формат файла результата
+    enum class output_format_t {
+        csv,     ///< median_result.csv: "receive_ts;price_median..."
+        binary,  ///< median_result.bin: записи фиксированной длины (result_writer.hpp)
+    };
+
+    /// Режим обработки
+    enum class pipeline_t {
+        batch,   ///< загрузить всё, отсортировать, посчитать, записать
+        stream,  ///< конвейер с ограниченной памятью (файлы должны быть упорядочены)
+    };
+
+    /// Движок расчёта медианы
+    enum class median_engine_t {
+        psquare,    ///< точно до seed_threshold значений, дальше оценка P^2 (постоянная память)
+        exact,      ///< две кучи: точная медиана, память линейна по числу строк
+        window,     ///< точная медиана в скользящем окне (window_us и/или window_ticks)
+        histogram,  ///< точная медиана по счётчикам тиков цены (tick_size), память — по диапазону цен
+    };
+
+    /// Секция [median]
+    struct median_config_t {
+        median_engine_t engine = median_engine_t::psquare;
+        std::size_t seed_threshold = 64;  ///< для psquare: сколько значений считать точно
+        std::uint64_t window_us = 0;      ///< для window: ширина окна по receive_ts, мкс
+        std::size_t window_ticks = 0;     ///< для window: число последних значений
+        double tick_size = 0;             ///< для histogram: шаг цены
+    };
+
+    /// Источник ключа группировки
+    enum class group_by_t {
+        none,    ///< без группировки: один результат на все файлы
+        file,    ///< ключ из имени файла (group.pattern)
+        column,  ///< ключ из колонки CSV (group.column)
+    };
+
+    /// Секция [group]
+    struct group_config_t {
+        group_by_t by = group_by_t::none;
+        std::string pattern = "(.*)";  ///< для file: regex по имени без расширения, ключ — группа 1
+        std::string column;            ///< для column: имя колонки
+    };
+
+    /// Секция [columns]: имена колонок входных файлов
+    struct columns_config_t {
+        std::string timestamp = "receive_ts";  ///< метка времени, мкс
+        std::string value = "price";           ///< значение для медианы
+        std::string weight = "quantity";       ///< вес для VWAP (stats.extras = ["vwap"])
+    };
+
+    /// Секция [stats]: дополнительные колонки результата
+    struct stats_config_t {
+        std::vector<double> quantiles;  ///< вероятности из (0, 1)
+        bool min = false;
+        bool max = false;
+        bool mean = false;
+        bool vwap = false;              ///< требует колонку quantity во входных файлах
+    };
+
+    /// Секция [follow]: слежение за дописыванием входных файлов (или флаг --follow)
+    struct follow_config_t {
+        bool enabled = false;
+        std::uint64_t reorder_us = 0;      ///< окно переупорядочивания строк разных файлов по receive_ts
+        std::size_t poll_ms = 500;         ///< наибольшая пауза между пересканированиями директории
+        std::size_t idle_flush_ms = 1000;  ///< без новых строк столько мс — отдать буфер целиком; 0 — не отдавать
+    };
+
     struct main_config_t {
-        std::filesystem::path input_dir;
+        std::vector<std::filesystem::path> input_dirs;  ///< входные директории (main.input — строка или массив)
+        bool recursive = false;                         ///< искать файлы и в поддиректориях
         std::filesystem::path output_dir;
+        output_format_t output_format = output_format_t::csv;
+        bool output_page_align = false;  ///< binary: заголовок до 4 КБ, записи — с границы страницы
         std::vector<std::string> filename_mask;
+        price_format_t price_format = price_format_t::floating;
+        std::size_t threads = 0;  ///< 0 — по числу ядер
+        std::size_t read_ahead_mb = 16;  ///< окно упреждающего чтения входных файлов, МБ; 0 — выключено
+        bool skip_invalid = false;       ///< пропускать неверные строки со сводкой в конце вместо ошибки
+        std::uint64_t max_errors = 0;    ///< при skip_invalid: больше стольких неверных строк за чтение — ошибка; 0 — без предела
+        sort_strategy_t sort = sort_strategy_t::merge;
+        pipeline_t pipeline = pipeline_t::batch;
+        emit_mode_t emit = emit_mode_t::row;
+        /// Файл контрольной точки; пусто — каждый запуск считает всё заново
+        std::filesystem::path checkpoint;
+        /// Двоичный кэш разобранных CSV (parse_cache.hpp)
+        bool cache = false;
+        /// Директория кэша; пусто — рядом с входными файлами
+        std::filesystem::path cache_dir;
+        /// Файл JSON с метриками стадий; пусто — только сводка в логе
+        std::filesystem::path metrics;
+        median_config_t median;
+        columns_config_t columns;
+        group_config_t group;
+        stats_config_t stats;
+        follow_config_t follow;
     };
 
+    /**
+     * \brief Проверяет совместимость режимов (вызывается и после флагов командной строки).
+     * \return std::nullopt если сочетание допустимо, иначе строка с описанием ошибки
+     */
+    inline std::optional<std::string> check_modes(const main_config_t& config) {
+        if (!config.checkpoint.empty()
+            && (config.pipeline == pipeline_t::stream || config.group.by != group_by_t::none)) {
+            return std::string("Ошибка конфига: 'main.checkpoint' поддерживается только в пакетном режиме без группировки");
+        }
+        if (config.group.by != group_by_t::none && config.pipeline == pipeline_t::stream) {
+            return std::string("Ошибка конфига: группировка поддерживается только при 'main.pipeline = \"batch\"'");
+        }
+        if (config.cache && (config.pipeline == pipeline_t::stream || config.group.by == group_by_t::column
+            || !config.checkpoint.empty() || config.follow.enabled)) {
+            return std::string("Ошибка конфига: 'main.cache' поддерживается только в пакетном режиме "
+                "без контрольной точки, слежения и группировки по колонке");
+        }
+        if (config.follow.enabled && (config.pipeline == pipeline_t::stream
+            || config.group.by != group_by_t::none || !config.checkpoint.empty())) {
+            return std::string("Ошибка конфига: слежение (follow) поддерживается только в пакетном режиме "
+                "без группировки и контрольной точки");
+        }
+        return std::nullopt;
+    }
+
     /**
      * \brief Парсит TOML конфиг и заполняет out_config.
      * \param path путь к файлу config.toml
@@ -40,12 +178,32 @@ namespace cfg {
                 return std::string("В конфиге отсутствует секция [main]");
             }
 
-            // input (обязательный)
+            // input (обязательный): директория или непустой массив директорий
+            out_config.input_dirs.clear();
             if (auto in = main_node["input"].value<std::string>(); in) {
-                out_config.input_dir = std::filesystem::path(*in);
+                out_config.input_dirs.emplace_back(*in);
             }
-            else {
-                return std::string("Ошибка конфига: 'main.input' обязателен и должен быть строкой");
+            else if (auto arr = main_node["input"]; arr && arr.is_array()) {
+                for (const auto& item : *arr.as_array()) {
+                    auto s = item.value<std::string>();
+                    if (!s || s->empty()) {
+                        return std::string("Ошибка конфига: элементы 'main.input' должны быть непустыми строками");
+                    }
+                    out_config.input_dirs.emplace_back(*s);
+                }
+            }
+            if (out_config.input_dirs.empty()) {
+                return std::string("Ошибка конфига: 'main.input' обязателен и должен быть строкой или непустым массивом строк");
+            }
+
+            // recursive (опционально): обходить поддиректории входных директорий
+            out_config.recursive = false;
+            if (auto rc = main_node["recursive"]; rc) {
+                auto v = rc.value<bool>();
+                if (!v) {
+                    return std::string("Ошибка конфига: 'main.recursive' должен быть true или false");
+                }
+                out_config.recursive = *v;
             }
 
             // output (опционально)
@@ -56,6 +214,28 @@ namespace cfg {
                 out_config.output_dir.clear();
             }
 
+            // output_format / output_page_align (опционально): формат файла результата
+            out_config.output_format = output_format_t::csv;
+            if (auto of = main_node["output_format"].value<std::string>(); of) {
+                if (*of == "binary") {
+                    out_config.output_format = output_format_t::binary;
+                }
+                else if (*of != "csv") {
+                    return std::string("Ошибка конфига: 'main.output_format' должен быть \"csv\" или \"binary\"");
+                }
+            }
+            out_config.output_page_align = false;
+            if (auto pa = main_node["output_page_align"]; pa) {
+                auto v = pa.value<bool>();
+                if (!v) {
+                    return std::string("Ошибка конфига: 'main.output_page_align' должен быть true или false");
+                }
+                if (*v && out_config.output_format != output_format_t::binary) {
+                    return std::string("Ошибка конфига: 'main.output_page_align' задаётся только для 'main.output_format = \"binary\"'");
+                }
+                out_config.output_page_align = *v;
+            }
+
             // filename_mask (опционально)
             out_config.filename_mask.clear();
             if (auto masks = main_node["filename_mask"]; masks && masks.is_array()) {
@@ -65,6 +245,305 @@ namespace cfg {
                     }
                 }
             }
+
+            // threads (опционально): число потоков чтения, 0 — по числу ядер
+            out_config.threads = 0;
+            if (auto th = main_node["threads"]; th) {
+                auto v = th.value<std::int64_t>();
+                if (!v || *v < 0) {
+                    return std::string("Ошибка конфига: 'main.threads' должен быть целым числом >= 0");
+                }
+                out_config.threads = static_cast<std::size_t>(*v);
+            }
+
+            // read_ahead_mb (опционально): сколько МБ файла запрашивать у ОС впереди разбора
+            out_config.read_ahead_mb = 16;
+            if (auto ra = main_node["read_ahead_mb"]; ra) {
+                auto v = ra.value<std::int64_t>();
+                if (!v || *v < 0 || *v > 4096) {
+                    return std::string("Ошибка конфига: 'main.read_ahead_mb' должен быть целым числом от 0 до 4096");
+                }
+                out_config.read_ahead_mb = static_cast<std::size_t>(*v);
+            }
+
+            // skip_invalid / max_errors (опционально): пропуск неверных строк
+            out_config.skip_invalid = false;
+            if (auto si = main_node["skip_invalid"]; si) {
+                auto v = si.value<bool>();
+                if (!v) {
+                    return std::string("Ошибка конфига: 'main.skip_invalid' должен быть true или false");
+                }
+                out_config.skip_invalid = *v;
+            }
+            out_config.max_errors = 0;
+            if (auto me = main_node["max_errors"]; me) {
+                auto v = me.value<std::int64_t>();
+                if (!v || *v < 0) {
+                    return std::string("Ошибка конфига: 'main.max_errors' должен быть целым числом >= 0");
+                }
+                if (!out_config.skip_invalid) {
+                    return std::string("Ошибка конфига: 'main.max_errors' задаётся только вместе с 'main.skip_invalid = true'");
+                }
+                out_config.max_errors = static_cast<std::uint64_t>(*v);
+            }
+
+            // price_format (опционально): "double" (по умолчанию) или "fixed"
+            out_config.price_format = price_format_t::floating;
+            if (auto pf = main_node["price_format"].value<std::string>(); pf) {
+                if (*pf == "fixed") {
+                    out_config.price_format = price_format_t::fixed;
+                }
+                else if (*pf != "double") {
+                    return std::string("Ошибка конфига: 'main.price_format' должен быть \"double\" или \"fixed\"");
+                }
+            }
+
+            // sort (опционально): "merge" (по умолчанию) или "full"
+            out_config.sort = sort_strategy_t::merge;
+            if (auto so = main_node["sort"].value<std::string>(); so) {
+                if (*so == "full") {
+                    out_config.sort = sort_strategy_t::full;
+                }
+                else if (*so != "merge") {
+                    return std::string("Ошибка конфига: 'main.sort' должен быть \"merge\" или \"full\"");
+                }
+            }
+
+            // pipeline (опционально): "batch" (по умолчанию) или "stream"
+            out_config.pipeline = pipeline_t::batch;
+            if (auto pl = main_node["pipeline"].value<std::string>(); pl) {
+                if (*pl == "stream") {
+                    out_config.pipeline = pipeline_t::stream;
+                }
+                else if (*pl != "batch") {
+                    return std::string("Ошибка конфига: 'main.pipeline' должен быть \"batch\" или \"stream\"");
+                }
+            }
+
+            // emit (опционально): "row" (по умолчанию) или "timestamp"
+            out_config.emit = emit_mode_t::row;
+            if (auto em = main_node["emit"].value<std::string>(); em) {
+                if (*em == "timestamp") {
+                    out_config.emit = emit_mode_t::timestamp;
+                }
+                else if (*em != "row") {
+                    return std::string("Ошибка конфига: 'main.emit' должен быть \"row\" или \"timestamp\"");
+                }
+            }
+
+            // checkpoint (опционально): путь к файлу контрольной точки инкрементального режима
+            out_config.checkpoint.clear();
+            if (auto cp = main_node["checkpoint"]; cp) {
+                auto v = cp.value<std::string>();
+                if (!v || v->empty()) {
+                    return std::string("Ошибка конфига: 'main.checkpoint' должен быть непустой строкой");
+                }
+                out_config.checkpoint = std::filesystem::path(*v);
+            }
+
+            // cache / cache_dir (опционально): двоичный кэш разобранных файлов
+            out_config.cache = false;
+            out_config.cache_dir.clear();
+            if (auto ca = main_node["cache"]; ca) {
+                auto v = ca.value<bool>();
+                if (!v) {
+                    return std::string("Ошибка конфига: 'main.cache' должен быть true или false");
+                }
+                out_config.cache = *v;
+            }
+            if (auto cd = main_node["cache_dir"]; cd) {
+                auto v = cd.value<std::string>();
+                if (!v || v->empty()) {
+                    return std::string("Ошибка конфига: 'main.cache_dir' должен быть непустой строкой");
+                }
+                out_config.cache_dir = std::filesystem::path(*v);
+            }
+
+            // metrics (опционально): JSON с временем стадий и пиковой памятью
+            out_config.metrics.clear();
+            if (auto mt = main_node["metrics"]; mt) {
+                auto v = mt.value<std::string>();
+                if (!v || v->empty()) {
+                    return std::string("Ошибка конфига: 'main.metrics' должен быть непустой строкой");
+                }
+                out_config.metrics = std::filesystem::path(*v);
+            }
+
+            // [median] (опционально)
+            out_config.median = median_config_t{};
+            if (auto median_node = tbl["median"]; median_node) {
+                if (auto en = median_node["engine"].value<std::string>(); en) {
+                    if (*en == "exact") {
+                        out_config.median.engine = median_engine_t::exact;
+                    }
+                    else if (*en == "window") {
+                        out_config.median.engine = median_engine_t::window;
+                    }
+                    else if (*en == "histogram") {
+                        out_config.median.engine = median_engine_t::histogram;
+                    }
+                    else if (*en != "psquare") {
+                        return std::string("Ошибка конфига: 'median.engine' должен быть \"psquare\", \"exact\", "
+                            "\"window\" или \"histogram\"");
+                    }
+                }
+                if (auto st = median_node["seed_threshold"]; st) {
+                    auto v = st.value<std::int64_t>();
+                    // P^2 даёт осмысленную оценку только с 5 значений (до этого его маркеры не отсортированы)
+                    if (!v || *v < 5) {
+                        return std::string("Ошибка конфига: 'median.seed_threshold' должен быть целым числом >= 5");
+                    }
+                    out_config.median.seed_threshold = static_cast<std::size_t>(*v);
+                }
+                if (auto wu = median_node["window_us"]; wu) {
+                    auto v = wu.value<std::int64_t>();
+                    if (!v || *v < 1) {
+                        return std::string("Ошибка конфига: 'median.window_us' должен быть целым числом >= 1");
+                    }
+                    out_config.median.window_us = static_cast<std::uint64_t>(*v);
+                }
+                if (auto wt = median_node["window_ticks"]; wt) {
+                    auto v = wt.value<std::int64_t>();
+                    if (!v || *v < 1) {
+                        return std::string("Ошибка конфига: 'median.window_ticks' должен быть целым числом >= 1");
+                    }
+                    out_config.median.window_ticks = static_cast<std::size_t>(*v);
+                }
+                if (auto ts = median_node["tick_size"]; ts) {
+                    auto v = ts.value<double>();
+                    if (!v || !(*v > 0) || !std::isfinite(*v)) {
+                        return std::string("Ошибка конфига: 'median.tick_size' должен быть числом > 0");
+                    }
+                    out_config.median.tick_size = *v;
+                }
+            }
+            if (out_config.median.engine == median_engine_t::window
+                && out_config.median.window_us == 0 && out_config.median.window_ticks == 0) {
+                return std::string("Ошибка конфига: для 'median.engine = \"window\"' нужен 'median.window_us' или 'median.window_ticks'");
+            }
+            if (out_config.median.engine == median_engine_t::histogram && out_config.median.tick_size == 0) {
+                return std::string("Ошибка конфига: для 'median.engine = \"histogram\"' нужен 'median.tick_size'");
+            }
+
+            // [columns] (опционально)
+            out_config.columns = columns_config_t{};
+            if (auto columns_node = tbl["columns"]; columns_node) {
+                const auto read_name = [&](const char* key, std::string& field) -> std::optional<std::string> {
+                    auto node = columns_node[key];
+                    if (!node) return std::nullopt;
+                    auto v = node.value<std::string>();
+                    if (!v || v->empty() || v->find(';') != std::string::npos) {
+                        return std::string("Ошибка конфига: 'columns.") + key + "' должен быть непустой строкой без ';'";
+                    }
+                    field = *v;
+                    return std::nullopt;
+                };
+                if (auto err = read_name("timestamp", out_config.columns.timestamp)) return err;
+                if (auto err = read_name("value", out_config.columns.value)) return err;
+                if (auto err = read_name("weight", out_config.columns.weight)) return err;
+            }
+            if (out_config.columns.timestamp == out_config.columns.value) {
+                return std::string("Ошибка конфига: 'columns.timestamp' и 'columns.value' должны быть разными колонками");
+            }
+
+            // [group] (опционально)
+            out_config.group = group_config_t{};
+            if (auto group_node = tbl["group"]; group_node) {
+                if (auto by = group_node["by"].value<std::string>(); by) {
+                    if (*by == "file") {
+                        out_config.group.by = group_by_t::file;
+                    }
+                    else if (*by == "column") {
+                        out_config.group.by = group_by_t::column;
+                    }
+                    else if (*by != "none") {
+                        return std::string("Ошибка конфига: 'group.by' должен быть \"none\", \"file\" или \"column\"");
+                    }
+                }
+                if (auto pat = group_node["pattern"].value<std::string>(); pat) {
+                    out_config.group.pattern = *pat;
+                }
+                if (auto col = group_node["column"].value<std::string>(); col) {
+                    out_config.group.column = *col;
+                }
+            }
+            if (out_config.group.by == group_by_t::file) {
+                try {
+                    std::regex check(out_config.group.pattern);
+                }
+                catch (const std::regex_error& ex) {
+                    return std::string("Ошибка конфига: 'group.pattern' — неверное регулярное выражение: ") + ex.what();
+                }
+            }
+            if (out_config.group.by == group_by_t::column && out_config.group.column.empty()) {
+                return std::string("Ошибка конфига: для 'group.by = \"column\"' нужен 'group.column'");
+            }
+            // [stats] (опционально)
+            out_config.stats = stats_config_t{};
+            if (auto stats_node = tbl["stats"]; stats_node) {
+                if (auto qs = stats_node["quantiles"]; qs) {
+                    if (!qs.is_array()) {
+                        return std::string("Ошибка конфига: 'stats.quantiles' должен быть массивом чисел");
+                    }
+                    for (const auto& item : *qs.as_array()) {
+                        auto q = item.value<double>();
+                        if (!q || !(*q > 0.0 && *q < 1.0)) {
+                            return std::string("Ошибка конфига: 'stats.quantiles' — вероятности должны быть в (0, 1)");
+                        }
+                        out_config.stats.quantiles.push_back(*q);
+                    }
+                }
+                if (auto ex = stats_node["extras"]; ex) {
+                    if (!ex.is_array()) {
+                        return std::string("Ошибка конфига: 'stats.extras' должен быть массивом строк");
+                    }
+                    for (const auto& item : *ex.as_array()) {
+                        const auto name = item.value<std::string>();
+                        if (name && *name == "min") out_config.stats.min = true;
+                        else if (name && *name == "max") out_config.stats.max = true;
+                        else if (name && *name == "mean") out_config.stats.mean = true;
+                        else if (name && *name == "vwap") out_config.stats.vwap = true;
+                        else {
+                            return std::string("Ошибка конфига: 'stats.extras' допускает \"min\", \"max\", \"mean\", \"vwap\"");
+                        }
+                    }
+                }
+            }
+
+            // [follow] (опционально)
+            out_config.follow = follow_config_t{};
+            if (auto follow_node = tbl["follow"]; follow_node) {
+                if (auto en = follow_node["enabled"]; en) {
+                    auto v = en.value<bool>();
+                    if (!v) {
+                        return std::string("Ошибка конфига: 'follow.enabled' должен быть true или false");
+                    }
+                    out_config.follow.enabled = *v;
+                }
+                if (auto ro = follow_node["reorder_us"]; ro) {
+                    auto v = ro.value<std::int64_t>();
+                    if (!v || *v < 0) {
+                        return std::string("Ошибка конфига: 'follow.reorder_us' должен быть целым числом >= 0");
+                    }
+                    out_config.follow.reorder_us = static_cast<std::uint64_t>(*v);
+                }
+                if (auto pm = follow_node["poll_ms"]; pm) {
+                    auto v = pm.value<std::int64_t>();
+                    if (!v || *v < 1) {
+                        return std::string("Ошибка конфига: 'follow.poll_ms' должен быть целым числом >= 1");
+                    }
+                    out_config.follow.poll_ms = static_cast<std::size_t>(*v);
+                }
+                if (auto fl = follow_node["idle_flush_ms"]; fl) {
+                    auto v = fl.value<std::int64_t>();
+                    if (!v || *v < 0) {
+                        return std::string("Ошибка конфига: 'follow.idle_flush_ms' должен быть целым числом >= 0");
+                    }
+                    out_config.follow.idle_flush_ms = static_cast<std::size_t>(*v);
+                }
+            }
+
+            if (auto err = check_modes(out_config)) return err;
         }
         catch (const toml::parse_error& ex) {
             return std::string("Ошибка парсинга TOML: ") + ex.what();
@@ -4,27 +4,50 @@
  * \brief Утилиты чтения CSV файлов (разделитель ';')
  *
  * Простая, безопасная логика: парсинг заголовка, поиск колонок receive_ts и price,
- * валидация значений и составление vector<record_t>.
+ * валидация значений и заполнение колоночного хранилища (record_store.hpp).
+ *
+ * Файлы отображаются в память (mapped_file.hpp), строки и поля разбираются как
+ * std::string_view поверх отображённых байт — без аллокаций на каждое поле.
+ * Границы полей ищет векторный сканер (simd_scan.hpp); из строки извлекаются
+ * только колонки receive_ts и price, остальные пропускаются.
+ *
+ * С read_options::cache разобранные файлы сохраняются в двоичный кэш
+ * (parse_cache.hpp), и повторные запуски загружают массивы без разбора текста.
+ *
+ * Файлы .csv.gz и .csv.zst распаковываются потоком (compressed_input.hpp):
+ * блоки целых строк разбираются тем же parse_rows, файлы — параллельно.
  */
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <filesystem>
-#include <fstream>
 #include <sstream>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
 #include <optional>
+#include <array>
 #include <algorithm>
 #include <charconv>
+#include <limits>
+#include <bit>
+#include <cmath>
+
+#include "compressed_input.hpp"
+#include "mapped_file.hpp"
+#include "parse_cache.hpp"
+#include "record_store.hpp"
+#include "simd_scan.hpp"
+#include "thread_pool.hpp"
 
 namespace csv {
 
-    struct record_t {
-        std::uint64_t receive_ts;
-        long double price;
-        std::string source_file;
-        std::uint64_t line_no;
-    };
+    /// Число знаков после точки в ценах (формат 68480.10000000)
+    inline constexpr int price_fraction_digits = 8;
+    /// Множитель фиксированной точки: цена хранится как price * price_scale
+    inline constexpr std::int64_t price_scale = 100'000'000;
 
     /// Разбить строку по разделителю (простая реализация, не обрабатывает кавычки)
     inline std::vector<std::string> split_line(const std::string& line, char sep = ';') {
@@ -38,21 +61,50 @@ namespace csv {
         return out;
     }
 
-    /// Парсинг long double с проверкой ошибок
-    inline bool parse_long_double(const std::string& s, long double& out_val) {
-        try {
-            size_t idx = 0;
-            out_val = std::stold(s, &idx);
-            return idx == s.size();
-        }
-        catch (...) {
-            return false;
+    /**
+     * \brief Разбить строку по разделителю без копирования полей.
+     *
+     * Семантика совпадает с split_line: пустой хвостовой токен отбрасывается.
+     * out переиспользуется между вызовами, чтобы не аллоцировать на каждой строке.
+     */
+    inline void split_line(std::string_view line, std::vector<std::string_view>& out, char sep = ';') {
+        out.clear();
+        std::size_t pos = 0;
+        while (pos < line.size()) {
+            const auto next = line.find(sep, pos);
+            if (next == std::string_view::npos) {
+                out.push_back(line.substr(pos));
+                break;
+            }
+            out.push_back(line.substr(pos, next - pos));
+            pos = next + 1;
         }
     }
 
+    /// Обрезать пробельные символы по краям
+    inline std::string_view trim(std::string_view s) {
+        const auto b = s.find_first_not_of(" \t\r\n");
+        if (b == std::string_view::npos) return {};
+        const auto e = s.find_last_not_of(" \t\r\n");
+        return s.substr(b, e - b + 1);
+    }
+
+    /// Парсинг long double с проверкой ошибок
+    inline bool parse_long_double(std::string_view s, long double& out_val) {
+        // strtold требует нуль-терминированную строку: копируем в буфер на стеке
+        char buf[64];
+        if (s.empty() || s.size() >= sizeof(buf)) return false;
+        std::memcpy(buf, s.data(), s.size());
+        buf[s.size()] = '\0';
+        char* end = nullptr;
+        errno = 0;
+        out_val = std::strtold(buf, &end);
+        return errno != ERANGE && end == buf + s.size();
+    }
+
     /// Парсинг unsigned 64-bit
-    inline bool parse_u64(const std::string& s, std::uint64_t& out_val) {
-        const char* begin = s.c_str();
+    inline bool parse_u64(std::string_view s, std::uint64_t& out_val) {
+        const char* begin = s.data();
         const char* end = begin + s.size();
         unsigned long long tmp = 0;
         auto res = std::from_chars(begin, end, tmp);
@@ -63,88 +115,1061 @@ namespace csv {
         return false;
     }
 
+    /// Индексы нужных колонок, найденные по заголовку файла
+    struct column_projection {
+        static constexpr std::size_t no_column = std::numeric_limits<std::size_t>::max();
+
+        std::size_t receive_ts = 0;
+        std::size_t price = 0;
+        std::size_t key = no_column;       ///< колонка ключа группы (group_by.hpp), если задана
+        std::size_t quantity = no_column;  ///< колонка объёма, если запрошена
+        std::size_t last = 0;  ///< последняя нужная колонка: хвост строки не токенизируется
+    };
+
     /**
-     * \brief Считает все CSV файлы в директории dir, фильтруя по masks (если пусто — все .csv).
-     * \param dir путь к директории
-     * \param masks маски по имени файла
-     * \param out_records выходной вектор записей
+     * \brief Имена колонок, которые нужно найти в заголовке.
+     *
+     * Метка времени и значение обязательны; имена по умолчанию — как во входных
+     * файлах examples/input, в конфиге задаются секцией [columns].
+     */
+    struct column_request {
+        std::string ts_column = "receive_ts";     ///< метка времени (мкс, целое без знака)
+        std::string price_column = "price";       ///< значение, по которому считается медиана
+        std::string quantity_column = "quantity"; ///< вес (объём), читается при quantity
+        std::string key_column;  ///< колонка ключа группы; пусто — не читать
+        bool quantity = false;   ///< читать колонку веса (для VWAP)
+
+        /// Описание требуемых колонок для сообщений об ошибках
+        std::string describe() const {
+            std::string s = ts_column + ", " + price_column;
+            if (quantity) s += ", " + quantity_column;
+            if (!key_column.empty()) s += ", " + key_column;
+            return s;
+        }
+    };
+
+    /**
+     * \brief Находит в заголовке колонки метки времени, значения и запрошенные необязательные колонки.
+     * \return false, если хотя бы одной колонки нет
+     *
+     * Заголовок разбирается один раз на файл; дальше строки токенизируются
+     * только до proj.last.
+     */
+    inline bool resolve_projection(std::string_view header, column_projection& out,
+        const column_request& request = {}) {
+        // поля перебираются на месте, без временного вектора токенов
+        int idx_receive = -1, idx_price = -1, idx_key = -1, idx_quantity = -1;
+        std::size_t start = 0;
+        for (int i = 0; start < header.size(); ++i) {
+            auto end = header.find(';', start);
+            if (end == std::string_view::npos) end = header.size();
+            const auto c = trim(header.substr(start, end - start));
+            start = end + 1;
+            if (c == request.ts_column) idx_receive = int(i);
+            if (c == request.price_column) idx_price = int(i);
+            if (request.quantity && c == request.quantity_column) idx_quantity = int(i);
+            if (!request.key_column.empty() && c == request.key_column) idx_key = int(i);
+        }
+        if (idx_receive < 0 || idx_price < 0) return false;
+        if (!request.key_column.empty() && idx_key < 0) return false;
+        if (request.quantity && idx_quantity < 0) return false;
+        const auto column = [](int idx) {
+            return idx < 0 ? column_projection::no_column : static_cast<std::size_t>(idx);
+        };
+        out.receive_ts = static_cast<std::size_t>(idx_receive);
+        out.price = static_cast<std::size_t>(idx_price);
+        out.key = column(idx_key);
+        out.quantity = column(idx_quantity);
+        out.last = std::max(out.receive_ts, out.price);
+        if (idx_key >= 0) out.last = std::max(out.last, out.key);
+        if (idx_quantity >= 0) out.last = std::max(out.last, out.quantity);
+        return true;
+    }
+
+    enum class row_status { ok, empty, short_row };
+
+    /**
+     * \brief Извлекает из строки, начинающейся с pos, нужные поля (см. column_projection).
+     *
+     * Границы полей берутся из битовых масок курсора; колонки после proj.last
+     * не разбираются — курсор сразу переходит к следующему '\n'.
+     * Пустое поле в конце строки считается отсутствующим (как в split_line).
+     * pos сдвигается на начало следующей строки.
+     */
+    inline row_status scan_row(std::string_view data, simd::block_cursor& cur, std::size_t& pos,
+        const column_projection& proj, std::string_view& ts_field, std::string_view& price_field,
+        std::string_view& key_field, std::string_view& quantity_field) {
+        if (data[pos] == '\n') {
+            ++pos;
+            return row_status::empty;
+        }
+        std::size_t start = pos;
+        for (std::size_t field = 0;; ++field) {
+            const std::size_t b = cur.next_any(start);
+            const bool line_end = b >= data.size() || data[b] == '\n';
+            const auto value = data.substr(start, b - start);
+            if (field == proj.receive_ts) ts_field = value;
+            if (field == proj.price) price_field = value;
+            if (field == proj.key) key_field = value;
+            if (field == proj.quantity) quantity_field = value;
+            if (field == proj.last) {
+                pos = (line_end ? b : cur.next_newline(b + 1)) + 1;
+                return (line_end && value.empty()) ? row_status::short_row : row_status::ok;
+            }
+            if (line_end) {
+                pos = b + 1;
+                return row_status::short_row;
+            }
+            start = b + 1;
+        }
+    }
+
+    /**
+     * \brief Парсинг double через std::from_chars (не зависит от локали).
+     *
+     * "nan" и "inf" from_chars принимает, но они не считаются числом: NaN не равен
+     * сам себе и ломает порядок в кучах и окне медианы, бесконечность — сетку тиков.
+     */
+    inline bool parse_double(std::string_view s, double& out_val) {
+        const char* begin = s.data();
+        const char* end = begin + s.size();
+        auto res = std::from_chars(begin, end, out_val);
+        return res.ec == std::errc() && res.ptr == end && begin != end && std::isfinite(out_val);
+    }
+
+    namespace detail {
+        /// Проверяет, что 8 байт (little-endian) — десятичные цифры
+        inline bool is_eight_digits(std::uint64_t v) {
+            return (((v + 0x4646464646464646ULL) | (v - 0x3030303030303030ULL)) & 0x8080808080808080ULL) == 0;
+        }
+
+        /// Перевод 8 ASCII-цифр в число за три умножения (SWAR)
+        inline std::uint32_t parse_eight_digits(std::uint64_t v) {
+            v -= 0x3030303030303030ULL;
+            v = (v * 10) + (v >> 8);
+            v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+                (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+            return static_cast<std::uint32_t>(v);
+        }
+    }  // namespace detail
+
+    /**
+     * \brief Парсинг цены в фиксированную точку: "68480.10000000" -> 6848010000000.
+     *
+     * Допускаются знак '-', пустая целая или дробная часть ("5.", ".5") и до
+     * price_fraction_digits значащих знаков после точки (лишние знаки допустимы
+     * только нулями). Ровно 8 дробных цифр — частый случай — разбираются SWAR.
+     */
+    inline bool parse_fixed_price(std::string_view s, std::int64_t& out_val) {
+        const char* p = s.data();
+        const char* const end = p + s.size();
+        const bool neg = (p != end && *p == '-');
+        if (neg) ++p;
+
+        constexpr auto max_value = static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max());
+        constexpr std::uint64_t max_int_part = max_value / std::uint64_t(price_scale);
+        std::uint64_t int_part = 0;
+        const char* const int_begin = p;
+        while (p != end && static_cast<unsigned char>(*p - '0') < 10) {
+            int_part = int_part * 10 + static_cast<unsigned>(*p - '0');
+            if (int_part > max_int_part) return false;
+            ++p;
+        }
+        bool has_digits = p != int_begin;
+
+        std::uint64_t frac = 0;
+        if (p != end && *p == '.') {
+            ++p;
+            std::uint64_t word = 0;
+            if (std::endian::native == std::endian::little && end - p == price_fraction_digits &&
+                (std::memcpy(&word, p, 8), detail::is_eight_digits(word))) {
+                frac = detail::parse_eight_digits(word);
+                p = end;
+                has_digits = true;
+            }
+            else {
+                int digits = 0;
+                for (; p != end && static_cast<unsigned char>(*p - '0') < 10; ++p, ++digits) {
+                    if (digits < price_fraction_digits) {
+                        frac = frac * 10 + static_cast<unsigned>(*p - '0');
+                    }
+                    else if (*p != '0') {
+                        return false;  // точность выше price_scale потеряна бы молча
+                    }
+                }
+                has_digits = has_digits || digits > 0;
+                for (; digits < price_fraction_digits; ++digits) frac *= 10;
+            }
+        }
+        if (p != end || !has_digits) return false;
+
+        const std::uint64_t u = int_part * std::uint64_t(price_scale) + frac;
+        if (u > max_value) return false;
+        out_val = neg ? -static_cast<std::int64_t>(u) : static_cast<std::int64_t>(u);
+        return true;
+    }
+
+    /// Парсинг цены в тип записи (перегрузка по типу выходного значения)
+    inline bool parse_price(std::string_view s, double& out_val) { return parse_double(s, out_val); }
+    inline bool parse_price(std::string_view s, std::int64_t& out_val) { return parse_fixed_price(s, out_val); }
+
+    /// Ошибка разбора строки данных
+    enum class row_error { none, short_row, bad_receive_ts, bad_price, bad_quantity, too_many_lines };
+
+    /// Текст ошибки строки с контекстом файл/строка
+    inline std::string describe_row_error(row_error e, const std::string& source_file, std::uint64_t line_no,
+        const column_request& request = {}) {
+        const auto bad = [&](const std::string& column) {
+            return "Неверный " + column + " в файле " + source_file + " на строке " + std::to_string(line_no);
+        };
+        switch (e) {
+        case row_error::short_row:
+            return std::string("Неправильная строка (мало колонок) в файле ") + source_file +
+                " на строке " + std::to_string(line_no);
+        case row_error::bad_receive_ts:
+            return bad(request.ts_column);
+        case row_error::bad_price:
+            return bad(request.price_column);
+        case row_error::bad_quantity:
+            return bad(request.quantity_column);
+        case row_error::too_many_lines:
+            return std::string("Слишком много строк в файле ") + source_file;
+        default:
+            return {};
+        }
+    }
+
+    /// Итог разбора диапазона строк
+    struct parse_status {
+        std::uint64_t lines = 0;             ///< сколько строк (включая пустые) пройдено
+        row_error error = row_error::none;
+        std::uint64_t error_line = 0;        ///< номер строки с ошибкой (в нумерации вызывающего)
+        bool sorted = true;                  ///< receive_ts не убывает
+        std::uint64_t first_ts = 0;          ///< первый и последний receive_ts (если строки были)
+        std::uint64_t last_ts = 0;
+        std::size_t next = 0;                ///< начало первой неразобранной строки
+    };
+
+    /**
+     * \brief Журнал пропущенных неверных строк (read_options::skip_invalid).
+     *
+     * Ведётся на каждый кусок или файл отдельно, то есть одним потоком без блокировок;
+     * на горячем пути — только счётчики и номера первых строк. Тексты ошибок
+     * собираются в конце (describe), журналы кусков склеиваются по порядку (append).
+     */
+    struct row_error_log {
+        static constexpr std::size_t max_samples = 10;  ///< сколько первых строк запоминается
+
+        struct sample {
+            row_error error = row_error::none;
+            file_id_t file = 0;
+            std::uint64_t line = 0;
+        };
+
+        std::uint64_t count = 0;                        ///< пропущено строк
+        std::array<std::uint64_t, 6> by_kind{};         ///< по видам, индекс — row_error
+        std::vector<sample> samples;                    ///< первые max_samples строк по порядку
+
+        void add(row_error e, file_id_t file, std::uint64_t line) {
+            ++count;
+            ++by_kind[static_cast<std::size_t>(e)];
+            if (samples.size() < max_samples) samples.push_back({ e, file, line });
+        }
+
+        /// Дописывает журнал следующего по порядку куска; line_offset прибавляется к его номерам строк
+        void append(const row_error_log& other, std::uint64_t line_offset = 0) {
+            count += other.count;
+            for (std::size_t k = 0; k < by_kind.size(); ++k) by_kind[k] += other.by_kind[k];
+            for (const auto& s : other.samples) {
+                if (samples.size() >= max_samples) break;
+                samples.push_back({ s.error, s.file, s.line + line_offset });
+            }
+        }
+
+        /// Текст ошибки строки s; paths — пути в порядке file_id
+        std::string describe(const sample& s, const std::vector<std::filesystem::path>& paths,
+            const column_request& request = {}) const {
+            return describe_row_error(s.error, s.file < paths.size() ? paths[s.file].string() : std::string("?"),
+                s.line, request);
+        }
+
+        /// Сводка по видам: "мало колонок: 3, receive_ts: 1"
+        std::string kinds(const column_request& request = {}) const {
+            const std::array<std::string, 6> names{ "", "мало колонок", request.ts_column, request.price_column,
+                request.quantity_column, "" };
+            std::string out;
+            for (std::size_t k = 0; k < by_kind.size(); ++k) {
+                if (by_kind[k] == 0) continue;
+                if (!out.empty()) out += ", ";
+                out += names[k] + ": " + std::to_string(by_kind[k]);
+            }
+            return out;
+        }
+    };
+
+    /**
+     * \brief Разбирает строки данных из [begin, end) и дописывает их в store.
+     * \param data всё содержимое файла (begin указывает на начало строки)
+     * \param line_before номер строки, предшествующей begin; строки нумеруются с line_before + 1
+     *
+     * \param max_lines разобрать не больше стольких строк (продолжить можно с status.next)
+     * \param skipped если задан — неверные строки пропускаются и учитываются в нём, а не останавливают разбор
+     *
+     * Разбор останавливается на первой ошибке, status.lines включает строку с ошибкой.
+     * Если в proj задана колонка ключа, ключи интернируются в store.groups;
+     * если задана колонка объёма — она дописывается в store.quantity.
+     */
+    template <class Price>
+    parse_status parse_rows(std::string_view data, std::size_t begin, std::size_t end,
+        const column_projection& proj, file_id_t file_id, std::uint64_t line_before,
+        basic_record_store<Price>& store,
+        std::uint64_t max_lines = std::numeric_limits<std::uint64_t>::max(),
+        row_error_log* skipped = nullptr) {
+        parse_status status;
+        const std::size_t first_row = store.size();
+        simd::block_cursor cur(data, ';');
+        std::size_t pos = begin;
+        std::string_view ts_field, price_field, key_field, quantity_field;
+        const bool with_key = proj.key != column_projection::no_column;
+        const bool with_quantity = proj.quantity != column_projection::no_column;
+        while (pos < end && status.lines < max_lines) {
+            const std::uint64_t line_no = line_before + ++status.lines;
+            const auto fail = [&](row_error e) {
+                status.error = e;
+                status.error_line = line_no;
+                status.next = pos;
+                return status;
+            };
+            if (line_no > std::numeric_limits<line_no_t>::max()) return fail(row_error::too_many_lines);
+
+            const auto st = scan_row(data, cur, pos, proj, ts_field, price_field, key_field, quantity_field);
+            if (st == row_status::empty) continue;
+
+            std::uint64_t receive_ts = 0;
+            Price price{};
+            double quantity = 0.0;
+            row_error bad = row_error::none;
+            if (st == row_status::short_row) bad = row_error::short_row;
+            else if (!parse_u64(ts_field, receive_ts)) bad = row_error::bad_receive_ts;
+            else if (!parse_price(price_field, price)) bad = row_error::bad_price;
+            else if (with_quantity && !parse_double(quantity_field, quantity)) bad = row_error::bad_quantity;
+            if (bad != row_error::none) {
+                if (!skipped) return fail(bad);
+                skipped->add(bad, file_id, line_no);
+                continue;
+            }
+
+            if (store.size() == first_row) {
+                status.first_ts = receive_ts;
+            }
+            else if (receive_ts < status.last_ts) {
+                status.sorted = false;
+            }
+            status.last_ts = receive_ts;
+            store.push_back(receive_ts, price, file_id, static_cast<line_no_t>(line_no));
+            if (with_key) store.group_id.push_back(store.groups.intern(trim(key_field)));
+            if (with_quantity) store.quantity.push_back(quantity);
+        }
+        status.next = pos;
+        return status;
+    }
+
+    /// Позиция в файле для инкрементального чтения
+    struct file_position {
+        std::uint64_t offset = 0;  ///< начало первой неразобранной строки; 0 — файл не читался
+        std::uint64_t line = 0;    ///< строк до offset, включая заголовок
+    };
+
+    /// Параметры чтения набора файлов
+    struct read_options {
+        /// Файлы крупнее делятся на куски по границам строк и разбираются параллельно
+        std::size_t chunk_bytes = std::size_t(32) << 20;
+        /// Имена колонок и необязательные колонки (ключ группы, объём)
+        column_request columns;
+        /// Откуда продолжать каждый файл (индекс — как у путей); пусто — все файлы с начала
+        std::vector<file_position> start;
+        /// Разбирать только строки, завершённые '\n': недописанный хвост остаётся до следующего запуска
+        bool complete_lines_only = false;
+        /// Двоичный кэш разобранных файлов (parse_cache.hpp); только для чтения файлов целиком без ключа группы
+        bool cache = false;
+        /// Директория кэша; пусто — рядом с входными файлами
+        std::filesystem::path cache_dir;
+        /// Упреждающее чтение (mapped_file::prefetch): окно впереди распаковки сжатого файла; 0 — выключено и для кусков
+        std::size_t read_ahead_bytes = default_read_ahead_bytes;
+        /// Пропускать неверные строки (учёт в read_summary::skipped) вместо ошибки чтения
+        bool skip_invalid = false;
+        /// При skip_invalid: больше стольких неверных строк — всё же ошибка; 0 — без предела
+        std::uint64_t max_errors = 0;
+    };
+
+    /// Итоги чтения набора файлов
+    struct read_summary {
+        /// Докуда разобран каждый файл (для read_options::start следующего запуска)
+        std::vector<file_position> ends;
+        std::uint64_t bytes = 0;       ///< байт текста разобрано (без файлов из кэша)
+        std::size_t cache_hits = 0;    ///< файлов загружено из кэша
+        std::size_t cache_writes = 0;  ///< файлов записано в кэш
+        row_error_log skipped;         ///< пропущенные неверные строки (read_options::skip_invalid)
+    };
+
+    /// Отображённый файл и разобранный заголовок
+    struct mapped_input {
+        mapped_file file;
+        column_projection proj;
+        std::size_t body_begin = 0;          ///< начало первой строки данных
+        std::optional<std::string> error;    ///< ошибка открытия или заголовка
+    };
+
+    /// Разбирает заголовок в начале data (пустые данные — файл пропускается)
+    inline bool read_header(std::string_view data, const std::filesystem::path& path, mapped_input& in,
+        const column_request& request) {
+        if (data.empty()) return true;
+        auto header_end = data.find('\n');
+        if (header_end == std::string_view::npos) header_end = data.size();
+        if (!resolve_projection(data.substr(0, header_end), in.proj, request)) {
+            in.error = std::string("CSV файл не содержит required columns (") + request.describe() + "): " + path.string();
+            return false;
+        }
+        in.body_begin = std::min(header_end + 1, data.size());
+        return true;
+    }
+
+    /**
+     * \brief Отображает файл и разбирает заголовок; ошибка сохраняется в in.error.
+     * \return false при ошибке
+     */
+    inline bool open_input(const std::filesystem::path& path, mapped_input& in, const column_request& request = {}) {
+        if ((in.error = in.file.open(path))) return false;
+        return read_header(in.file.view(), path, in, request);
+    }
+
+    /**
+     * \brief Открывает сжатый файл, распаковывает первый блок и разбирает заголовок.
+     * \param block первый блок текста; данные начинаются с in.body_begin (может быть == block.size())
+     * \return false при ошибке (она сохраняется в in.error); in.file не используется
+     */
+    inline bool open_compressed(const std::filesystem::path& path, codec::compressed_reader& reader,
+        mapped_input& in, std::string_view& block, const column_request& request = {}) {
+        if ((in.error = reader.open(path))) return false;
+        if ((in.error = reader.next(block))) return false;
+        return read_header(block, path, in, request);
+    }
+
+    /**
+     * \brief Читает один CSV файл (через отображение в память) и дописывает записи в store.
+     * \param path путь к файлу
+     * \param file_id номер файла в store.files
+     * \param store выходное хранилище записей
+     * \tparam Price double или std::int64_t (фиксированная точка с price_scale)
      * \return std::nullopt при успехе или строка с описанием ошибки
      */
-    inline std::optional<std::string> read_csv_files(const std::filesystem::path& dir,
-        const std::vector<std::string>& masks,
-        std::vector<record_t>& out_records) {
-        if (!std::filesystem::exists(dir)) {
-            return std::string("Входная директория не существует: ") + dir.string();
-        }
-        if (!std::filesystem::is_directory(dir)) {
-            return std::string("Входной путь не является директорией: ") + dir.string();
-        }
-
-        out_records.clear();
-        for (const auto& entry : std::filesystem::directory_iterator(dir)) {
-            if (!entry.is_regular_file()) continue;
-            const auto fname = entry.path().filename().string();
-            // проверить расширение .csv (регистр игнорируется)
-            const auto ext = entry.path().extension().string();
-            if (ext.empty()) continue;
-            std::string ext_lower = ext;
-            std::transform(ext_lower.begin(), ext_lower.end(), ext_lower.begin(), ::tolower);
-            if (ext_lower != ".csv") continue;
-
-            // фильтрация по маскам
-            bool pass = masks.empty();
+    template <class Price>
+    std::optional<std::string> read_csv_file(const std::filesystem::path& path, file_id_t file_id,
+        basic_record_store<Price>& store) {
+        mapped_input in;
+        if (!open_input(path, in)) return in.error;
+        const std::string_view data = in.file.view();
+
+        const std::size_t first_row = store.size();
+        const auto st = parse_rows(data, in.body_begin, data.size(), in.proj, file_id, 1, store);
+        if (store.runs.size() <= file_id) store.runs.resize(std::size_t(file_id) + 1);
+        store.runs[file_id] = run_t{ first_row, store.size(), st.sorted };
+        if (st.error != row_error::none) {
+            return describe_row_error(st.error, path.string(), st.error_line);
+        }
+        if (store.size() > std::numeric_limits<row_index_t>::max()) {
+            return std::string("Слишком много записей (предел ") +
+                std::to_string(std::numeric_limits<row_index_t>::max()) + "), файл " + path.string();
+        }
+        return std::nullopt;
+    }
+
+    namespace detail {
+        /// Кусок файла, выровненный по границам строк, и его результат
+        template <class Price>
+        struct chunk_task {
+            std::size_t input = 0;
+            std::size_t begin = 0;
+            std::size_t end = 0;
+            basic_record_store<Price> rows;      ///< номера строк относительно начала куска
+            parse_status status;
+            bool ready = false;                  ///< строки уже готовы (файл из кэша или распакован), разбор не нужен
+            std::size_t reserve_rows = 0;        ///< оценка числа строк: буферы куска выделяются один раз
+            row_error_log skipped;               ///< пропущенные строки, номера — относительно начала куска
+        };
+
+        /// Средняя длина строки по первому блоку данных ([begin, begin + 64 КБ))
+        inline double sample_bytes_per_row(std::string_view data, std::size_t begin) {
+            const auto sample = data.substr(std::min(begin, data.size()), std::size_t(64) << 10);
+            const auto lines = std::count(sample.begin(), sample.end(), '\n');
+            if (lines == 0) return std::max<double>(static_cast<double>(sample.size()), 1.0);
+            return static_cast<double>(sample.size()) / static_cast<double>(lines);
+        }
+
+        /// Строк в bytes байт текста с запасом 1/8 на неровную длину строк
+        inline std::size_t estimate_rows(double bytes_per_row, double bytes) {
+            return static_cast<std::size_t>(bytes / bytes_per_row * 1.125) + 16;
+        }
+
+        /// Резервирует буферы под rows строк, включая запрошенные необязательные колонки
+        template <class Price>
+        void reserve_rows(basic_record_store<Price>& store, std::size_t rows, const column_request& request) {
+            store.reserve(rows);
+            if (!request.key_column.empty()) store.group_id.reserve(rows);
+            if (request.quantity) store.quantity.reserve(rows);
+        }
+
+        /**
+         * \brief Распаковывает и разбирает сжатый файл целиком; номера строк в rows — от заголовка.
+         * \param skipped если задан — неверные строки пропускаются (см. parse_rows)
+         * \return ошибка открытия, распаковки или заголовка; ошибка строки — в status.error
+         */
+        template <class Price>
+        std::optional<std::string> parse_compressed(const std::filesystem::path& path, const column_request& request,
+            file_id_t file_id, basic_record_store<Price>& rows, parse_status& status,
+            std::uint64_t& source_size, std::uint64_t& text_bytes, std::size_t read_ahead_bytes,
+            row_error_log* skipped) {
+            codec::compressed_reader reader;
+            reader.set_read_ahead(read_ahead_bytes);
+            mapped_input in;
+            std::string_view block;
+            if (!open_compressed(path, reader, in, block, request)) return in.error;
+            source_size = reader.source_size();
+            std::size_t pos = in.body_begin;
+            if (!block.empty() && reader.source_consumed() != 0) {
+                // объём текста — по степени сжатия первого блока
+                const double ratio = static_cast<double>(reader.text_bytes()) / static_cast<double>(reader.source_consumed());
+                reserve_rows(rows, estimate_rows(sample_bytes_per_row(block, pos),
+                    static_cast<double>(source_size) * ratio), request);
+            }
+            while (!block.empty()) {
+                const std::size_t before = rows.size();
+                const auto st = parse_rows(block, pos, block.size(), in.proj, file_id, status.lines, rows,
+                    std::numeric_limits<std::uint64_t>::max(), skipped);
+                if (rows.size() != before) {
+                    if (before == 0) status.first_ts = st.first_ts;
+                    else if (st.first_ts < status.last_ts) status.sorted = false;
+                    status.last_ts = st.last_ts;
+                }
+                status.sorted = status.sorted && st.sorted;
+                status.lines += st.lines;
+                if (st.error != row_error::none) {
+                    status.error = st.error;
+                    status.error_line = st.error_line;
+                    break;
+                }
+                if (auto err = reader.next(block)) return err;
+                pos = 0;
+            }
+            text_bytes = reader.text_bytes();
+            return std::nullopt;
+        }
+
+        /// Делит [begin, size) на куски ~chunk_bytes, концы сдвигаются за ближайший '\n'
+        inline void split_chunks(std::string_view data, std::size_t begin, std::size_t chunk_bytes,
+            std::vector<std::pair<std::size_t, std::size_t>>& out) {
+            chunk_bytes = std::max<std::size_t>(chunk_bytes, 1);
+            while (begin < data.size()) {
+                std::size_t end = data.size();
+                if (data.size() - begin > chunk_bytes) {
+                    const auto nl = data.find('\n', begin + chunk_bytes - 1);
+                    end = nl == std::string_view::npos ? data.size() : nl + 1;
+                }
+                out.emplace_back(begin, end);
+                begin = end;
+            }
+        }
+
+        /**
+         * \brief Индексы 0..weights.size() по убыванию веса (равные — по возрастанию индекса).
+         *
+         * Пул раздаёт задачи по порядку, поэтому самые долгие задачи в этом порядке
+         * начинаются первыми и не остаются одни в хвосте, пока остальные потоки простаивают.
+         */
+        inline std::vector<std::size_t> largest_first(const std::vector<std::uint64_t>& weights) {
+            std::vector<std::size_t> order(weights.size());
+            for (std::size_t i = 0; i < order.size(); ++i) order[i] = i;
+            std::stable_sort(order.begin(), order.end(),
+                [&](std::size_t a, std::size_t b) { return weights[a] > weights[b]; });
+            return order;
+        }
+    }  // namespace detail
+
+    /// Где искать входные файлы
+    struct input_spec {
+        std::vector<std::filesystem::path> roots;  ///< входные директории
+        /// Маски: подстрока имени файла или шаблон с * и ? (с '/' — по пути от корня, ** — любые директории)
+        std::vector<std::string> masks;
+        bool recursive = false;                    ///< обходить поддиректории
+    };
+
+    namespace detail {
+        /// Сопоставление с шаблоном: * и ? не переходят через '/', ** совпадает с любыми символами
+        inline bool glob_match(std::string_view pattern, std::string_view text) {
+            while (!pattern.empty()) {
+                if (pattern.starts_with("**")) {
+                    pattern.remove_prefix(2);
+                    // "**/" совпадает и с нулём директорий
+                    if (pattern.starts_with('/') && glob_match(pattern.substr(1), text)) return true;
+                    for (std::size_t i = 0; i <= text.size(); ++i) {
+                        if (glob_match(pattern, text.substr(i))) return true;
+                    }
+                    return false;
+                }
+                if (pattern.front() == '*') {
+                    pattern.remove_prefix(1);
+                    for (std::size_t i = 0;; ++i) {
+                        if (glob_match(pattern, text.substr(i))) return true;
+                        if (i == text.size() || text[i] == '/') return false;
+                    }
+                }
+                if (text.empty()) return false;
+                if (pattern.front() == '?' ? text.front() == '/' : pattern.front() != text.front()) return false;
+                pattern.remove_prefix(1);
+                text.remove_prefix(1);
+            }
+            return text.empty();
+        }
+
+        /// Проходит ли файл (путь rel от корня входной директории) хотя бы одну маску
+        inline bool mask_passes(const std::vector<std::string>& masks, const std::filesystem::path& rel) {
+            if (masks.empty()) return true;
+            const auto name = rel.filename().string();
             for (const auto& m : masks) {
-                if (fname.find(m) != std::string::npos) { pass = true; break; }
+                if (m.find_first_of("*?") == std::string::npos) {
+                    if (name.find(m) != std::string::npos) return true;
+                }
+                else if (glob_match(m, m.find('/') != std::string::npos ? rel.generic_string() : name)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    }  // namespace detail
+
+    /**
+     * \brief Находит CSV файлы (.csv, .csv.gz, .csv.zst) во входных директориях, фильтруя по маскам.
+     *
+     * Директории обходятся по уровням: все директории уровня читаются параллельно
+     * на pool (на сетевых ФС время уходит на readdir и stat, а не на процессор).
+     * Символические ссылки на директории не обходятся.
+     * \param out_paths найденные пути без повторов, отсортированные по строковому представлению
+     * \return std::nullopt при успехе или строка с описанием ошибки
+     */
+    inline std::optional<std::string> find_csv_files(const input_spec& spec,
+        std::vector<std::filesystem::path>& out_paths, par::thread_pool& pool) {
+        out_paths.clear();
+        const auto& roots = spec.roots;
+        for (const auto& dir : roots) {
+            if (!std::filesystem::exists(dir)) {
+                return std::string("Входная директория не существует: ") + dir.string();
+            }
+            if (!std::filesystem::is_directory(dir)) {
+                return std::string("Входной путь не является директорией: ") + dir.string();
+            }
+        }
+
+        struct dir_task {
+            std::filesystem::path dir;
+            std::size_t root;  ///< индекс в roots — от него считается путь для масок
+        };
+        std::vector<dir_task> level;
+        for (std::size_t r = 0; r < roots.size(); ++r) level.push_back({ roots[r], r });
+        while (!level.empty()) {
+            std::vector<std::vector<std::filesystem::path>> files(level.size());
+            std::vector<std::vector<dir_task>> subdirs(level.size());
+            std::vector<std::optional<std::string>> errors(level.size());
+            pool.parallel_for(level.size(), [&](std::size_t k) {
+                const auto& task = level[k];
+                std::error_code ec;
+                for (std::filesystem::directory_iterator it(task.dir, ec), end; !ec && it != end; it.increment(ec)) {
+                    const auto& entry = *it;
+                    std::error_code type_ec;
+                    if (spec.recursive && entry.is_directory(type_ec) && !entry.is_symlink(type_ec)) {
+                        subdirs[k].push_back({ entry.path(), task.root });
+                        continue;
+                    }
+                    // расширение .csv, .csv.gz или .csv.zst (регистр игнорируется)
+                    if (!codec::is_csv_name(entry.path()) || !entry.is_regular_file(type_ec)) continue;
+                    if (!detail::mask_passes(spec.masks, entry.path().lexically_relative(roots[task.root]))) continue;
+                    files[k].push_back(entry.path());
+                }
+                if (ec) errors[k] = "Не удалось прочитать директорию " + task.dir.string() + ": " + ec.message();
+                // порядок следующего уровня не зависит от порядка обхода директории
+                std::sort(subdirs[k].begin(), subdirs[k].end(),
+                    [](const dir_task& a, const dir_task& b) { return a.dir.string() < b.dir.string(); });
+            });
+            std::vector<dir_task> next;
+            for (std::size_t k = 0; k < level.size(); ++k) {
+                if (errors[k]) return errors[k];
+                out_paths.insert(out_paths.end(), files[k].begin(), files[k].end());
+                next.insert(next.end(), subdirs[k].begin(), subdirs[k].end());
+            }
+            level.swap(next);
+        }
+        // порядок file_id не зависит от порядка обхода; пересекающиеся корни не дают повторов
+        std::sort(out_paths.begin(), out_paths.end(),
+            [](const auto& a, const auto& b) { return a.string() < b.string(); });
+        out_paths.erase(std::unique(out_paths.begin(), out_paths.end(),
+            [](const auto& a, const auto& b) { return a.string() == b.string(); }), out_paths.end());
+        return std::nullopt;
+    }
+
+    /**
+     * \brief Находит CSV файлы в одной директории dir (без поддиректорий), фильтруя по masks (если пусто — все).
+     * \param out_paths найденные пути, отсортированные по строковому представлению
+     * \return std::nullopt при успехе или строка с описанием ошибки
+     */
+    inline std::optional<std::string> find_csv_files(const std::filesystem::path& dir,
+        const std::vector<std::string>& masks,
+        std::vector<std::filesystem::path>& out_paths) {
+        par::thread_pool serial(1);
+        return find_csv_files(input_spec{ { dir }, masks, false }, out_paths, serial);
+    }
+
+    /**
+     * \brief Читает заданные CSV файлы; file_id — индекс в paths.
+     * \param paths пути в порядке file_id
+     * \param out_store выходное хранилище записей
+     * \param pool потоки для параллельного разбора файлов и их кусков
+     * \param summary если задан — докуда разобран каждый файл и работа кэша
+     * \return std::nullopt при успехе или строка с описанием ошибки
+     *
+     * Куски разбираются в отдельные буферы и склеиваются в порядке (файл, кусок),
+     * поэтому результат и первая сообщаемая ошибка не зависят от числа потоков.
+     * Файл, загруженный из кэша, становится одним готовым куском без разбора.
+     * Сжатый файл распаковывается и разбирается целиком одной задачей пула
+     * (параллельно с другими файлами) и тоже становится одним готовым куском.
+     * Файлы и куски раздаются потокам от больших к меньшим (detail::largest_first).
+     * Байты куска запрашиваются у ОС заранее (read_options::read_ahead_bytes != 0):
+     * задача запрашивает свой кусок и кусок, который начнётся после текущих.
+     * При skip_invalid журналы кусков склеиваются в том же порядке (файл, кусок).
+     */
+    template <class Price>
+    std::optional<std::string> read_csv_paths(const std::vector<std::filesystem::path>& paths,
+        basic_record_store<Price>& out_store,
+        par::thread_pool& pool,
+        const read_options& options = {},
+        read_summary* summary = nullptr) {
+        out_store.clear();
+        for (const auto& path : paths) {
+            if (!out_store.add_file(path)) {
+                return std::string("Слишком много входных файлов: ") + std::to_string(paths.size());
             }
-            if (!pass) continue;
+        }
+        const auto start_of = [&](std::size_t i) {
+            return i < options.start.size() ? options.start[i] : file_position{};
+        };
 
-            // открыть файл
-            std::ifstream ifs(entry.path());
-            if (!ifs.is_open()) {
-                return std::string("Не удалось открыть CSV файл: ") + entry.path().string();
+        // ---- кэш, открытие файлов и разбор заголовков ----
+        const bool use_cache = options.cache && options.start.empty() && !options.complete_lines_only
+            && options.columns.key_column.empty();
+        const auto columns_key = cache::columns_key(options.columns.ts_column, options.columns.price_column,
+            options.columns.quantity_column);
+        std::vector<std::optional<cache::source_stamp>> stamps(paths.size());
+        std::vector<basic_record_store<Price>> prefilled(paths.size());  ///< строки из кэша или сжатого файла
+        std::vector<cache::file_summary> cached_info(use_cache ? paths.size() : 0);
+        std::vector<char> from_cache(paths.size(), 0);
+        std::vector<char> packed(paths.size(), 0);
+        std::vector<parse_status> packed_status(paths.size());
+        std::vector<std::uint64_t> packed_size(paths.size(), 0);   ///< размер сжатого файла
+        std::vector<std::uint64_t> packed_bytes(paths.size(), 0);  ///< байт распакованного текста
+        std::vector<row_error_log> packed_skipped(options.skip_invalid ? paths.size() : 0);
+        std::vector<mapped_input> inputs(paths.size());
+        std::vector<std::size_t> body_end(paths.size(), 0);  ///< конец разбираемой части файла
+        std::vector<std::uint64_t> file_bytes(paths.size(), 0);
+        pool.parallel_for(paths.size(), [&](std::size_t i) {
+            std::error_code ec;
+            const auto size = std::filesystem::file_size(paths[i], ec);
+            file_bytes[i] = ec ? 0 : size;
+        });
+        const auto file_order = detail::largest_first(file_bytes);
+        pool.parallel_for(paths.size(), [&](std::size_t k) {
+            const std::size_t i = file_order[k];
+            auto& in = inputs[i];
+            if (use_cache && (stamps[i] = cache::stamp_of(paths[i]))) {
+                from_cache[i] = cache::load(cache::sidecar_path<Price>(paths[i], options.cache_dir), *stamps[i],
+                    columns_key, options.columns.quantity, static_cast<file_id_t>(i), prefilled[i], cached_info[i]);
+                if (from_cache[i]) return;
+            }
+            if (codec::compression_of(paths[i]) != codec::compression::none) {
+                if (!options.start.empty() || options.complete_lines_only) {
+                    in.error = std::string("Сжатые файлы не поддерживаются при продолжении с контрольной точки "
+                        "и слежении: ") + paths[i].string();
+                    return;
+                }
+                packed[i] = 1;
+                in.error = detail::parse_compressed(paths[i], options.columns, static_cast<file_id_t>(i),
+                    prefilled[i], packed_status[i], packed_size[i], packed_bytes[i], options.read_ahead_bytes,
+                    options.skip_invalid ? &packed_skipped[i] : nullptr);
+                return;
             }
+            if (!options.complete_lines_only) {
+                open_input(paths[i], in, options.columns);
+                body_end[i] = in.file.view().size();
+                return;
+            }
+            if ((in.error = in.file.open(paths[i]))) return;
+            const auto data = in.file.view();
+            const auto last_nl = data.rfind('\n');
+            if (last_nl == std::string_view::npos) {
+                // заголовок ещё не дописан — файл пока пропускается
+                in.body_begin = body_end[i] = 0;
+                return;
+            }
+            body_end[i] = last_nl + 1;
+            read_header(data, paths[i], in, options.columns);
+        });
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            const auto from = start_of(i);
+            if (inputs[i].error || from.offset == 0) continue;
+            if (from.offset > inputs[i].file.size() || from.offset < inputs[i].body_begin) {
+                inputs[i].error = std::string("Файл изменился не дописыванием (позиция продолжения вне файла): ") +
+                    paths[i].string();
+                continue;
+            }
+            inputs[i].body_begin = static_cast<std::size_t>(from.offset);
+        }
 
-            std::string header;
-            if (!std::getline(ifs, header)) {
-                // пустой файл — пропускаем
+        // ---- разбор кусков ----
+        std::vector<detail::chunk_task<Price>> chunks;
+        std::vector<std::pair<std::size_t, std::size_t>> ranges;
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            if (inputs[i].error) break;  // последующие куски не понадобятся: ошибка уже первая
+            if (from_cache[i]) {
+                auto& c = chunks.emplace_back();
+                c.input = i;
+                c.ready = true;
+                c.rows = std::move(prefilled[i]);
+                for (auto& line : c.rows.line_no) --line;  // в кэше — абсолютные номера, в куске — от заголовка
+                const auto& info = cached_info[i];
+                c.status.lines = info.lines;
+                c.status.sorted = info.sorted;
+                c.status.first_ts = info.first_ts;
+                c.status.last_ts = info.last_ts;
                 continue;
             }
-            auto cols = split_line(header, ';');
-            int idx_receive = -1, idx_price = -1;
-            for (size_t i = 0; i < cols.size(); ++i) {
-                auto c = cols[i];
-                c.erase(0, c.find_first_not_of(" \t\r\n"));
-                c.erase(c.find_last_not_of(" \t\r\n") + 1);
-                if (c == "receive_ts") idx_receive = int(i);
-                if (c == "price") idx_price = int(i);
+            if (packed[i]) {
+                auto& c = chunks.emplace_back();
+                c.input = i;
+                c.ready = true;
+                c.rows = std::move(prefilled[i]);
+                c.status = packed_status[i];
+                if (options.skip_invalid) c.skipped = std::move(packed_skipped[i]);
+                continue;
             }
-            if (idx_receive < 0 || idx_price < 0) {
-                return std::string("CSV файл не содержит required columns (receive_ts, price): ") + entry.path().string();
+            ranges.clear();
+            const auto body = inputs[i].file.view().substr(0, body_end[i]);
+            detail::split_chunks(body, inputs[i].body_begin, options.chunk_bytes, ranges);
+            const double bytes_per_row = ranges.empty() ? 1.0 : detail::sample_bytes_per_row(body, inputs[i].body_begin);
+            for (const auto& [b, e] : ranges) {
+                auto& c = chunks.emplace_back();
+                c.input = i;
+                c.begin = b;
+                c.end = e;
+                c.reserve_rows = detail::estimate_rows(bytes_per_row, static_cast<double>(e - b));
             }
+        }
+        std::vector<std::uint64_t> chunk_bytes(chunks.size(), 0);
+        for (std::size_t k = 0; k < chunks.size(); ++k) {
+            if (!chunks[k].ready) chunk_bytes[k] = chunks[k].end - chunks[k].begin;
+        }
+        const auto chunk_order = detail::largest_first(chunk_bytes);
+        const auto prefetch_chunk = [&](std::size_t k) {
+            if (options.read_ahead_bytes == 0 || k >= chunks.size()) return;
+            const auto& c = chunks[chunk_order[k]];
+            if (!c.ready) inputs[c.input].file.prefetch(c.begin, c.end - c.begin);
+        };
+        pool.parallel_for(chunks.size(), [&](std::size_t k) {
+            // свой кусок и тот, что пул раздаст следующим после текущих: чтение идёт, пока потоки разбирают
+            prefetch_chunk(k);
+            prefetch_chunk(k + pool.size());
+            auto& c = chunks[chunk_order[k]];
+            if (c.ready) return;
+            const auto& in = inputs[c.input];
+            detail::reserve_rows(c.rows, c.reserve_rows, options.columns);
+            c.status = parse_rows(in.file.view(), c.begin, c.end, in.proj,
+                static_cast<file_id_t>(c.input), 0, c.rows, std::numeric_limits<std::uint64_t>::max(),
+                options.skip_invalid ? &c.skipped : nullptr);
+        });
 
-            std::string line;
-            std::uint64_t line_no = 1;
-            while (std::getline(ifs, line)) {
-                ++line_no;
-                if (line.empty()) continue;
-                auto vals = split_line(line, ';');
-                if (vals.size() <= std::max(idx_receive, idx_price)) {
-                    return std::string("Неправильная строка (мало колонок) в файле ") + entry.path().string() +
-                        " на строке " + std::to_string(line_no);
+        // ---- первая ошибка в порядке (файл, строка), перевод номеров строк в абсолютные ----
+        std::vector<std::size_t> offsets(chunks.size() + 1, 0);
+        std::vector<std::uint64_t> line_base(chunks.size(), 0);
+        std::size_t next_chunk = 0;
+        std::vector<std::uint64_t> file_lines(inputs.size(), 0);
+        row_error_log skipped;
+        std::vector<char> has_skipped(inputs.size(), 0);  ///< такие файлы не кэшируются: пропуски сообщаются при каждом чтении
+        out_store.runs.assign(inputs.size(), run_t{});
+        if (summary) {
+            *summary = read_summary{};
+            summary->ends.resize(inputs.size());
+        }
+        for (std::size_t i = 0; i < inputs.size(); ++i) {
+            if (inputs[i].error) return inputs[i].error;
+            const auto from = start_of(i);
+            std::uint64_t base = from.offset != 0 ? from.line : 1;  // строка 1 — заголовок
+            auto& run = out_store.runs[i];
+            run.begin = run.end = offsets[next_chunk];
+            bool has_rows = false;
+            std::uint64_t last_ts = 0;
+            for (; next_chunk < chunks.size() && chunks[next_chunk].input == i; ++next_chunk) {
+                const auto& c = chunks[next_chunk];
+                if (c.status.error != row_error::none) {
+                    const auto line = base + c.status.error_line;
+                    const auto e = line > std::numeric_limits<line_no_t>::max() ? row_error::too_many_lines : c.status.error;
+                    return describe_row_error(e, paths[i].string(), line, options.columns);
                 }
-                std::uint64_t receive_ts = 0;
-                long double price = 0.0L;
-                if (!parse_u64(vals[idx_receive], receive_ts)) {
-                    return std::string("Неверный receive_ts в файле ") + entry.path().string() + " на строке " + std::to_string(line_no);
+                if (base + c.status.lines > std::numeric_limits<line_no_t>::max()) {
+                    return describe_row_error(row_error::too_many_lines, paths[i].string(), 0);
                 }
-                if (!parse_long_double(vals[idx_price], price)) {
-                    return std::string("Неверный price в файле ") + entry.path().string() + " на строке " + std::to_string(line_no);
+                line_base[next_chunk] = base;
+                if (c.skipped.count != 0) {
+                    skipped.append(c.skipped, base);
+                    has_skipped[i] = 1;
                 }
+                offsets[next_chunk + 1] = offsets[next_chunk] + c.rows.size();
+                base += c.status.lines;
+                // файл упорядочен, если упорядочен каждый кусок и куски не перекрываются
+                if (!c.rows.empty()) {
+                    run.sorted = run.sorted && c.status.sorted && (!has_rows || last_ts <= c.status.first_ts);
+                    has_rows = true;
+                    last_ts = c.status.last_ts;
+                }
+                run.end = offsets[next_chunk + 1];
+            }
+            file_lines[i] = base - 1;
+            if (summary && from_cache[i]) {
+                summary->ends[i] = { stamps[i]->size, base };
+                ++summary->cache_hits;
+            }
+            else if (summary && packed[i]) {
+                summary->ends[i] = { packed_size[i], base };
+                summary->bytes += packed_bytes[i];
+            }
+            else if (summary && body_end[i] != 0) {
+                const std::size_t end = std::min(std::max(inputs[i].body_begin, body_end[i]), inputs[i].file.size());
+                summary->ends[i] = { end, base };
+                summary->bytes += end - from.offset;
+            }
+        }
+        if (options.max_errors != 0 && skipped.count > options.max_errors) {
+            return "Неверных строк " + std::to_string(skipped.count) + " — больше предела max_errors ("
+                + std::to_string(options.max_errors) + "), первая: " + skipped.describe(skipped.samples.front(), paths,
+                    options.columns);
+        }
+        if (summary) summary->skipped = skipped;
+        const std::size_t total = offsets[chunks.size()];
+        if (total > std::numeric_limits<row_index_t>::max()) {
+            return std::string("Слишком много записей (предел ") +
+                std::to_string(std::numeric_limits<row_index_t>::max()) + ")";
+        }
 
-                out_records.push_back(record_t{ receive_ts, price, entry.path().string(), line_no });
+        // ---- склейка кусков в итоговое хранилище ----
+        // ключи групп каждого куска переводятся в общую таблицу в порядке (файл, кусок)
+        const bool with_key = !options.columns.key_column.empty();
+        const bool with_quantity = options.columns.quantity;
+        std::vector<std::vector<group_id_t>> group_remap(with_key ? chunks.size() : 0);
+        for (std::size_t k = 0; k < group_remap.size(); ++k) {
+            for (const auto& name : chunks[k].rows.groups.names) {
+                group_remap[k].push_back(out_store.groups.intern(name));
+            }
+        }
+        out_store.receive_ts.resize(total);
+        out_store.price.resize(total);
+        out_store.file_id.resize(total);
+        out_store.line_no.resize(total);
+        if (with_key) out_store.group_id.resize(total);
+        if (with_quantity) out_store.quantity.resize(total);
+        pool.parallel_for(chunks.size(), [&](std::size_t k) {
+            auto& c = chunks[k];
+            const std::size_t at = offsets[k];
+            const auto base = static_cast<line_no_t>(line_base[k]);
+            std::copy(c.rows.receive_ts.begin(), c.rows.receive_ts.end(), out_store.receive_ts.begin() + at);
+            std::copy(c.rows.price.begin(), c.rows.price.end(), out_store.price.begin() + at);
+            std::copy(c.rows.file_id.begin(), c.rows.file_id.end(), out_store.file_id.begin() + at);
+            for (std::size_t r = 0; r < c.rows.size(); ++r) {
+                out_store.line_no[at + r] = base + c.rows.line_no[r];
+            }
+            if (with_key) {
+                for (std::size_t r = 0; r < c.rows.size(); ++r) {
+                    out_store.group_id[at + r] = group_remap[k][c.rows.group_id[r]];
+                }
             }
+            if (with_quantity) {
+                std::copy(c.rows.quantity.begin(), c.rows.quantity.end(), out_store.quantity.begin() + at);
+            }
+            c.rows = {};
+        });
+
+        // ---- запись кэша для разобранных файлов ----
+        // кэш не пишется, если файл изменился между проверкой признака и отображением
+        if (use_cache) {
+            std::vector<char> written(inputs.size(), 0);
+            pool.parallel_for(inputs.size(), [&](std::size_t i) {
+                if (from_cache[i] || !stamps[i] || has_skipped[i]) return;
+                const std::uint64_t size = packed[i] ? packed_size[i] : inputs[i].file.size();
+                if (size == 0 || size != stamps[i]->size) return;
+                const auto& run = out_store.runs[i];
+                cache::file_summary info{ file_lines[i], run.sorted, 0, 0 };
+                if (run.end > run.begin) {
+                    info.first_ts = out_store.receive_ts[run.begin];
+                    info.last_ts = out_store.receive_ts[run.end - 1];
+                }
+                written[i] = !cache::save(cache::sidecar_path<Price>(paths[i], options.cache_dir), *stamps[i],
+                    columns_key, out_store, run.begin, run.end, info);
+            });
+            if (summary) summary->cache_writes = static_cast<std::size_t>(std::count(written.begin(), written.end(), 1));
         }
         return std::nullopt;
     }
 
+    /**
+     * \brief Считает все CSV файлы входных директорий spec (см. find_csv_files).
+     * \param out_store выходное хранилище записей
+     * \param pool потоки для обхода директорий и параллельного разбора файлов и их кусков
+     * \param summary если задан — итоги чтения (см. read_csv_paths)
+     * \return std::nullopt при успехе или строка с описанием ошибки
+     */
+    template <class Price>
+    std::optional<std::string> read_csv_files(const input_spec& spec,
+        basic_record_store<Price>& out_store,
+        par::thread_pool& pool,
+        const read_options& options = {},
+        read_summary* summary = nullptr) {
+        std::vector<std::filesystem::path> paths;
+        if (auto err = find_csv_files(spec, paths, pool)) {
+            return err;
+        }
+        return read_csv_paths(paths, out_store, pool, options, summary);
+    }
+
+    /**
+     * \brief Считает все CSV файлы в директории dir, фильтруя по masks (если пусто — все .csv).
+     * \param dir путь к директории
+     * \param masks маски по имени файла
+     * \param out_store выходное хранилище записей
+     * \param pool потоки для параллельного разбора файлов и их кусков
+     * \param summary если задан — итоги чтения (см. read_csv_paths)
+     * \return std::nullopt при успехе или строка с описанием ошибки
+     */
+    template <class Price>
+    std::optional<std::string> read_csv_files(const std::filesystem::path& dir,
+        const std::vector<std::string>& masks,
+        basic_record_store<Price>& out_store,
+        par::thread_pool& pool,
+        const read_options& options = {},
+        read_summary* summary = nullptr) {
+        return read_csv_files(input_spec{ { dir }, masks, false }, out_store, pool, options, summary);
+    }
+
+    /// Однопоточное чтение (см. перегрузку с пулом)
+    template <class Price>
+    std::optional<std::string> read_csv_files(const std::filesystem::path& dir,
+        const std::vector<std::string>& masks,
+        basic_record_store<Price>& out_store) {
+        par::thread_pool pool(1);
+        return read_csv_files(dir, masks, out_store, pool);
+    }
+
 }  // namespace csv
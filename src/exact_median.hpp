@@ -0,0 +1,122 @@
+﻿#pragma once
+/**
+ * \file exact_median.hpp
+ * \brief Точная инкрементальная медиана на двух кучах.
+ *
+ * Нижняя половина значений хранится в max-куче, верхняя — в min-куче;
+ * размеры куч отличаются не более чем на один. Вставка — O(log n),
+ * медиана — O(1) по вершинам куч. Память растёт линейно с числом значений,
+ * в отличие от P^2 (median_calculator.hpp), зато результат точный.
+ *
+ * Для чётного числа значений медиана — середина двух центральных значений,
+ * для целых с округлением вниз (как в basic_median_calculator).
+ */
+
+#include <vector>
+#include <span>
+#include <optional>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include <type_traits>
+
+namespace median {
+
+    template <class T>
+    class exact_median_calculator {
+        static_assert(std::is_arithmetic_v<T>, "median value type must be arithmetic");
+
+    public:
+        using value_type = T;
+
+        void add(T v) {
+            if (_low.empty() || v <= _low.front()) {
+                push(_low, v, std::less<T>{});
+            }
+            else {
+                push(_high, v, std::greater<T>{});
+            }
+            // инвариант: |low| == |high| или |low| == |high| + 1
+            if (_low.size() > _high.size() + 1) {
+                push(_high, pop(_low, std::less<T>{}), std::greater<T>{});
+            }
+            else if (_high.size() > _low.size()) {
+                push(_low, pop(_high, std::greater<T>{}), std::less<T>{});
+            }
+        }
+
+        /// То же, что add() для каждого значения по порядку
+        void add_batch(std::span<const T> values) {
+            for (T v : values) add(v);
+        }
+
+        /**
+         * \brief add_batch, сообщающий медиану после каждого значения.
+         * \param on_median вызывается как on_median(i, медиана после values[i])
+         */
+        template <class OnMedian>
+        void add_batch_and_emit(std::span<const T> values, OnMedian&& on_median) {
+            for (std::size_t i = 0; i < values.size(); ++i) {
+                add(values[i]);
+                on_median(i, top_median());
+            }
+        }
+
+        std::optional<T> median() const {
+            if (_low.empty()) return std::nullopt;
+            return top_median();
+        }
+
+        std::size_t size() const noexcept { return _low.size() + _high.size(); }
+
+        /// Выделить место под n значений заранее
+        void reserve(std::size_t n) {
+            _low.reserve(n / 2 + 1);
+            _high.reserve(n / 2 + 1);
+        }
+
+        void reset() {
+            _low.clear();
+            _high.clear();
+        }
+
+        /// Сохранение / восстановление состояния (архивы checkpoint.hpp)
+        template <class Archive>
+        void serialize_state(Archive& ar) {
+            ar & _low & _high;
+        }
+
+    private:
+        /// Медиана по вершинам куч; low не пуста
+        T top_median() const {
+            if (_low.size() > _high.size()) return _low.front();
+            const T lo = _low.front();
+            const T hi = _high.front();
+            if constexpr (std::is_integral_v<T>) {
+                return lo + (hi - lo) / 2;  // без переполнения, округление вниз
+            }
+            else {
+                return (lo + hi) / 2.0;
+            }
+        }
+
+        template <class Cmp>
+        static void push(std::vector<T>& heap, T v, Cmp cmp) {
+            heap.push_back(v);
+            std::push_heap(heap.begin(), heap.end(), cmp);
+        }
+
+        template <class Cmp>
+        static T pop(std::vector<T>& heap, Cmp cmp) {
+            std::pop_heap(heap.begin(), heap.end(), cmp);
+            const T v = heap.back();
+            heap.pop_back();
+            return v;
+        }
+
+    private:
+        std::vector<T> _low;   ///< нижняя половина, max-куча (вершина — максимум)
+        std::vector<T> _high;  ///< верхняя половина, min-куча (вершина — минимум)
+    };
+
+}  // namespace median
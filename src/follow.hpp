@@ -0,0 +1,243 @@
+﻿#pragma once
+/**
+ * \file follow.hpp
+ * \brief Режим слежения (--follow): ожидание дописывания входных файлов
+ *
+ * dir_watcher ждёт изменений во входных директориях: inotify на Linux,
+ * FindFirstChangeNotification на Windows, на остальных системах — просто
+ * таймаут (опрос). Событие означает лишь «стоит пересканировать»: какие файлы
+ * выросли, определяется по размеру, так что пропущенные события не теряют данных.
+ *
+ * reorder_buffer упорядочивает строки разных файлов по receive_ts: строка
+ * отдаётся на расчёт, когда максимальный увиденный receive_ts ушёл вперёд
+ * не меньше чем на окно переупорядочивания. Строки старше уже отданных
+ * считаются опоздавшими и отбрасываются со счётчиком.
+ */
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <optional>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include <cstdint>
+#include <cstddef>
+
+#include "record_store.hpp"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace follow {
+
+    namespace detail {
+        inline volatile std::sig_atomic_t stop_flag = 0;
+
+        inline void on_stop_signal(int) { stop_flag = 1; }
+    }  // namespace detail
+
+    /// SIGINT / SIGTERM завершают слежение штатно: буфер дописывается, файл закрывается
+    inline void install_stop_handlers() {
+        std::signal(SIGINT, detail::on_stop_signal);
+        std::signal(SIGTERM, detail::on_stop_signal);
+    }
+
+    inline bool stop_requested() noexcept { return detail::stop_flag != 0; }
+
+    /// Ожидание изменений во входных директориях
+    class dir_watcher {
+    public:
+        dir_watcher() = default;
+        ~dir_watcher() { close(); }
+
+        dir_watcher(const dir_watcher&) = delete;
+        dir_watcher& operator=(const dir_watcher&) = delete;
+
+        /**
+         * \brief Начинает следить за директориями dirs.
+         * \param recursive следить и за поддиректориями (в Linux — существующими на момент вызова;
+         *        изменения в новых поддиректориях находит пересканирование раз в poll_ms)
+         * \return std::nullopt при успехе, иначе строка с описанием ошибки
+         */
+        std::optional<std::string> open(const std::vector<std::filesystem::path>& dirs, bool recursive = false) {
+            close();
+#if defined(_WIN32)
+            for (const auto& dir : dirs) {
+                const HANDLE h = FindFirstChangeNotificationW(dir.c_str(), recursive ? TRUE : FALSE,
+                    FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE
+                    | FILE_NOTIFY_CHANGE_LAST_WRITE);
+                if (h == INVALID_HANDLE_VALUE || _handles.size() == MAXIMUM_WAIT_OBJECTS) {
+                    if (h != INVALID_HANDLE_VALUE) FindCloseChangeNotification(h);
+                    close();
+                    return std::string("Не удалось следить за директорией: ") + dir.string();
+                }
+                _handles.push_back(h);
+            }
+#elif defined(__linux__)
+            _fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (_fd < 0) {
+                return std::string("Не удалось инициализировать inotify");
+            }
+            for (const auto& dir : dirs) {
+                if (!add_watch(dir)) {
+                    close();
+                    return std::string("Не удалось следить за директорией: ") + dir.string();
+                }
+                if (!recursive) continue;
+                std::error_code ec;
+                for (std::filesystem::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+                    std::error_code type_ec;
+                    // поддиректория, за которой не удалось следить, всё равно пересканируется по таймауту
+                    if (it->is_directory(type_ec) && !it->is_symlink(type_ec)) add_watch(it->path());
+                }
+            }
+#else
+            (void)dirs;
+            (void)recursive;
+#endif
+            return std::nullopt;
+        }
+
+        /**
+         * \brief Ждёт изменений не дольше timeout.
+         * \return true, если пришло событие (или события недоступны), false — таймаут
+         */
+        bool wait(std::chrono::milliseconds timeout) {
+#if defined(_WIN32)
+            if (_handles.empty()) {
+                std::this_thread::sleep_for(timeout);
+                return false;
+            }
+            const DWORD r = WaitForMultipleObjects(static_cast<DWORD>(_handles.size()), _handles.data(), FALSE,
+                static_cast<DWORD>(timeout.count()));
+            if (r < WAIT_OBJECT_0 || r >= WAIT_OBJECT_0 + _handles.size()) return false;
+            FindNextChangeNotification(_handles[r - WAIT_OBJECT_0]);
+            return true;
+#elif defined(__linux__)
+            pollfd p{ _fd, POLLIN, 0 };
+            if (::poll(&p, 1, static_cast<int>(timeout.count())) <= 0) return false;
+            // события не разбираются: после любого директории сканируются целиком
+            alignas(inotify_event) char buf[4096];
+            while (::read(_fd, buf, sizeof(buf)) > 0) {}
+            return true;
+#else
+            std::this_thread::sleep_for(timeout);
+            return true;
+#endif
+        }
+
+        void close() noexcept {
+#if defined(_WIN32)
+            for (const HANDLE h : _handles) FindCloseChangeNotification(h);
+            _handles.clear();
+#elif defined(__linux__)
+            if (_fd >= 0) ::close(_fd);
+            _fd = -1;
+#endif
+        }
+
+    private:
+#if defined(_WIN32)
+        std::vector<HANDLE> _handles;  ///< по одному на входную директорию
+#elif defined(__linux__)
+        bool add_watch(const std::filesystem::path& dir) {
+            return ::inotify_add_watch(_fd, dir.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO) >= 0;
+        }
+
+        int _fd = -1;
+#endif
+    };
+
+    /**
+     * \brief Буфер переупорядочивания строк по receive_ts.
+     *
+     * file_id строк должны быть общими для всех порций (номер файла за всё
+     * время слежения): при равных receive_ts порядок — по файлу, затем по строке.
+     * Файлы сравниваются по рангу из set_file_order — месту пути среди известных
+     * файлов, как file_id пакетного режима; без него — по самому file_id.
+     * Строка с receive_ts, равным последнему выданному, не опоздавшая: она выдаётся
+     * следующей порцией, после уже выданных строк с той же меткой.
+     */
+    template <class Price>
+    class reorder_buffer {
+    public:
+        explicit reorder_buffer(std::uint64_t window) : _window(window) {}
+
+        /// Добавляет порцию строк; опоздавшие строки отбрасываются
+        void push(const csv::basic_record_store<Price>& rows) {
+            for (std::size_t i = 0; i < rows.size(); ++i) {
+                if (_released_any && rows.receive_ts[i] < _released_ts) {
+                    ++_late;
+                    continue;
+                }
+                _pending.copy_row_from(rows, i);
+                _max_ts = std::max(_max_ts, rows.receive_ts[i]);
+            }
+        }
+
+        /// \param rank rank[file_id] — место пути файла среди известных файлов в порядке сортировки путей
+        void set_file_order(std::vector<csv::file_id_t> rank) {
+            _by_rank.assign(rank.size(), 0);
+            for (std::size_t id = 0; id < rank.size(); ++id) _by_rank[rank[id]] = static_cast<csv::file_id_t>(id);
+            _rank = std::move(rank);
+        }
+
+        /**
+         * \brief Переносит в out строки с receive_ts <= max_ts - window по порядку.
+         * \param all отдать все строки независимо от окна (простой источника, завершение)
+         */
+        void release(csv::basic_record_store<Price>& out, bool all = false) {
+            out.clear();
+            if (_pending.empty()) return;
+            if (!all && _max_ts < _window) return;
+            if (!_rank.empty()) {
+                for (auto& f : _pending.file_id) f = _rank[f];
+                _pending.sort_by_time();
+                for (auto& f : _pending.file_id) f = _by_rank[f];
+            }
+            else {
+                _pending.sort_by_time();
+            }
+            const std::uint64_t limit = _max_ts - _window;
+            const std::size_t n = all ? _pending.size() : static_cast<std::size_t>(
+                std::upper_bound(_pending.receive_ts.begin(), _pending.receive_ts.end(), limit)
+                - _pending.receive_ts.begin());
+            if (n == 0) return;
+
+            csv::basic_record_store<Price> rest;
+            for (std::size_t i = 0; i < n; ++i) out.copy_row_from(_pending, i);
+            for (std::size_t i = n; i < _pending.size(); ++i) rest.copy_row_from(_pending, i);
+            _pending = std::move(rest);
+            _released_ts = out.receive_ts.back();
+            _released_any = true;
+        }
+
+        std::size_t pending() const noexcept { return _pending.size(); }
+
+        /// Сколько строк отброшено как опоздавшие (с начала слежения)
+        std::size_t late() const noexcept { return _late; }
+
+    private:
+        std::uint64_t _window;
+        std::vector<csv::file_id_t> _rank, _by_rank;  ///< file_id -> ранг пути и обратно
+        csv::basic_record_store<Price> _pending;
+        std::uint64_t _max_ts = 0;
+        std::uint64_t _released_ts = 0;
+        bool _released_any = false;
+        std::size_t _late = 0;
+    };
+
+}  // namespace follow
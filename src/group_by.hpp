@@ -0,0 +1,123 @@
+﻿#pragma once
+/**
+ * \file group_by.hpp
+ * \brief Группировка записей по ключу (инструменту) за один проход чтения
+ *
+ * Ключ строки берётся из имени файла (регулярное выражение) или из колонки CSV
+ * (csv::read_options::key_column). Хранилище делится на независимые части —
+ * по одной на ключ, — которые затем сортируются и считаются параллельно,
+ * каждая со своим калькулятором медианы и своим выходным файлом.
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <regex>
+#include <filesystem>
+#include <optional>
+#include <cstddef>
+
+#include "compressed_input.hpp"
+#include "record_store.hpp"
+#include "thread_pool.hpp"
+
+namespace group {
+
+    /**
+     * \brief Ключ по имени файла без расширения: первая группа захвата pattern,
+     *        а если групп нет — всё совпадение.
+     * \return std::nullopt, если имя не соответствует шаблону
+     */
+    inline std::optional<std::string> key_from_filename(const std::filesystem::path& path, const std::regex& pattern) {
+        const auto stem = csv::codec::csv_stem(path);
+        std::smatch m;
+        if (!std::regex_search(stem, m, pattern)) return std::nullopt;
+        return m.size() > 1 && m[1].matched ? m[1].str() : m[0].str();
+    }
+
+    /**
+     * \brief Заполняет store.group_id по именам файлов.
+     * \return std::nullopt при успехе, иначе описание ошибки
+     */
+    template <class Price>
+    std::optional<std::string> assign_file_keys(csv::basic_record_store<Price>& store, const std::string& pattern) {
+        const std::regex re(pattern);
+        std::vector<csv::group_id_t> file_group(store.files.size());
+        store.groups.clear();
+        for (std::size_t f = 0; f < store.files.size(); ++f) {
+            const auto key = key_from_filename(store.files[f], re);
+            if (!key) {
+                return std::string("Имя файла не соответствует group.pattern: ") + store.files[f].string();
+            }
+            file_group[f] = store.groups.intern(*key);
+        }
+        store.group_id.resize(store.size());
+        for (std::size_t i = 0; i < store.size(); ++i) {
+            store.group_id[i] = file_group[store.file_id[i]];
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * \brief Делит хранилище на части по group_id (индекс части — group_id).
+     *
+     * Внутри части строки сохраняют исходный порядок (файл, строка), поэтому
+     * строки каждого файла идут подряд и для части заново вычисляются runs —
+     * она готова к merge_by_time. Исходное хранилище не изменяется.
+     */
+    template <class Price>
+    std::vector<csv::basic_record_store<Price>> split_by_group(const csv::basic_record_store<Price>& store,
+        par::thread_pool& pool) {
+        const std::size_t groups = store.groups.size();
+        // сортировка подсчётом: индексы строк каждой группы подряд
+        std::vector<std::size_t> offsets(groups + 1, 0);
+        for (auto g : store.group_id) ++offsets[g + 1];
+        for (std::size_t g = 0; g < groups; ++g) offsets[g + 1] += offsets[g];
+        std::vector<csv::row_index_t> rows(store.size());
+        {
+            std::vector<std::size_t> fill(offsets.begin(), offsets.end() - 1);
+            for (std::size_t i = 0; i < store.size(); ++i) {
+                rows[fill[store.group_id[i]]++] = static_cast<csv::row_index_t>(i);
+            }
+        }
+
+        std::vector<csv::basic_record_store<Price>> parts(groups);
+        pool.parallel_for(groups, [&](std::size_t g) {
+            auto& part = parts[g];
+            part.files = store.files;
+            part.groups.intern(store.groups.names[g]);
+            part.runs.assign(store.files.size(), csv::run_t{});
+            part.reserve(offsets[g + 1] - offsets[g]);
+            for (std::size_t k = offsets[g]; k < offsets[g + 1]; ++k) {
+                const auto i = rows[k];
+                const auto f = store.file_id[i];
+                auto& run = part.runs[f];
+                if (run.end == run.begin) {
+                    run.begin = run.end = part.size();
+                }
+                else if (store.receive_ts[i] < part.receive_ts.back()) {
+                    run.sorted = false;
+                }
+                part.copy_row_from(store, i);
+                run.end = part.size();
+            }
+            // runs пустых файлов — пустой диапазон
+            for (auto& run : part.runs) {
+                if (run.end == run.begin) run.begin = run.end = 0;
+            }
+        });
+        return parts;
+    }
+
+    /// Имя выходного файла группы: символы вне [A-Za-z0-9._-] заменяются на '_'; extension — с точкой
+    inline std::string output_name(std::string_view key, std::string_view extension = ".csv") {
+        std::string name = "median_result_";
+        for (char c : key) {
+            const bool ok = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')
+                || c == '.' || c == '_' || c == '-';
+            name += ok ? c : '_';
+        }
+        return name + std::string(extension);
+    }
+
+}  // namespace group
@@ -0,0 +1,309 @@
+﻿#pragma once
+/**
+ * \file histogram_median.hpp
+ * \brief Точная медиана по гистограмме цен на сетке шага цены (tick_size).
+ *
+ * Цена переводится в номер тика; счётчики тиков лежат в плотном массиве вокруг
+ * встреченного диапазона цен и расширяются при выходе за него. Указатель на тик с
+ * нижней медианой и число значений ниже него сдвигаются при каждой вставке:
+ * ранг медианы меняется не больше чем на единицу, поэтому указатель переходит
+ * к соседнему занятому тику. Соседний занятый тик ищется по иерархии битовых масок
+ * занятости (tick_occupancy) за O(log64 диапазона), а не перебором пустых тиков, —
+ * далёкие друг от друга кластеры цен не замедляют вставку и запрос медианы.
+ * Память пропорциональна диапазону цен в тиках (8 байт на тик), а не числу
+ * строк, как у exact_median.hpp; результат тот же, пока цены лежат на сетке.
+ * Диапазон шире max_buckets тиков — исключение std::length_error; NaN, бесконечность
+ * и цена дальше 2^62 тиков от нуля — std::out_of_range.
+ *
+ * Цены вне сетки округляются до ближайшего тика и подсчитываются (off_grid()).
+ * Для double цена тика восстанавливается делением на 1 / tick_size, если оно
+ * целое (0.1, 0.01, 0.5...), — так значение совпадает с разобранным из текста.
+ * Для чётного числа значений медиана — середина двух центральных, для целых
+ * с округлением вниз (как в exact_median_calculator).
+ */
+
+#include <vector>
+#include <span>
+#include <string>
+#include <stdexcept>
+#include <optional>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <bit>
+#include <type_traits>
+
+namespace median {
+
+    namespace detail {
+        /**
+         * \brief Множество занятых индексов в [0, n): бит на индекс и уровни сводок
+         *        (бит уровня k+1 — непустое слово уровня k), поиск соседа за O(log64 n).
+         */
+        class tick_occupancy {
+        public:
+            static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+            void assign(std::size_t n) {
+                _levels.clear();
+                do {
+                    n = (n + 63) / 64;
+                    _levels.emplace_back(n, 0);
+                } while (n > 1);
+            }
+
+            void clear() { _levels.clear(); }
+
+            void set(std::size_t i) {
+                for (auto& words : _levels) {
+                    const std::uint64_t bit = std::uint64_t(1) << (i & 63);
+                    const bool was_empty = words[i >> 6] == 0;
+                    words[i >> 6] |= bit;
+                    if (!was_empty) return;
+                    i >>= 6;
+                }
+            }
+
+            /// Наименьший занятый индекс >= i; npos — нет
+            std::size_t next(std::size_t i) const {
+                std::size_t level = 0;
+                for (;; ++level) {
+                    if (level == _levels.size() || (i >> 6) >= _levels[level].size()) return npos;
+                    const std::uint64_t m = _levels[level][i >> 6] & (~std::uint64_t(0) << (i & 63));
+                    if (m != 0) {
+                        i = (i & ~std::size_t(63)) + static_cast<std::size_t>(std::countr_zero(m));
+                        break;
+                    }
+                    i = (i >> 6) + 1;
+                }
+                while (level-- > 0) i = (i << 6) + static_cast<std::size_t>(std::countr_zero(_levels[level][i]));
+                return i;
+            }
+
+            /// Наибольший занятый индекс <= i (i внутри диапазона); npos — нет
+            std::size_t prev(std::size_t i) const {
+                std::size_t level = 0;
+                for (;; ++level) {
+                    if (level == _levels.size()) return npos;
+                    const std::uint64_t m = _levels[level][i >> 6] & (~std::uint64_t(0) >> (63 - (i & 63)));
+                    if (m != 0) {
+                        i = (i & ~std::size_t(63)) + 63 - static_cast<std::size_t>(std::countl_zero(m));
+                        break;
+                    }
+                    if ((i >> 6) == 0) return npos;
+                    i = (i >> 6) - 1;
+                }
+                while (level-- > 0) {
+                    i = (i << 6) + 63 - static_cast<std::size_t>(std::countl_zero(_levels[level][i]));
+                }
+                return i;
+            }
+
+        private:
+            std::vector<std::vector<std::uint64_t>> _levels;  ///< [0] — бит на индекс
+        };
+    }  // namespace detail
+
+    template <class T>
+    class histogram_median_calculator {
+        static_assert(std::is_arithmetic_v<T>, "median value type must be arithmetic");
+
+    public:
+        using value_type = T;
+
+        /// Наибольший диапазон цен, тиков (1 ГиБ счётчиков)
+        static constexpr std::size_t max_buckets = std::size_t(1) << 27;
+
+        /// \param tick_size шаг цены в единицах T (для фиксированной точки — уже умноженный на масштаб), > 0
+        explicit histogram_median_calculator(T tick_size) : _tick(tick_size) {
+            if constexpr (std::is_floating_point_v<T>) {
+                const double per_unit = std::round(1.0 / _tick);
+                if (per_unit >= 1 && std::abs(per_unit * _tick - 1.0) < 1e-9) _per_unit = per_unit;
+            }
+        }
+
+        void add(T v) {
+            const std::int64_t t = tick_of(v);
+            if (_counts.empty() || t < _base || t >= _base + static_cast<std::int64_t>(_counts.size())) grow(t);
+            const auto i = static_cast<std::size_t>(t - _base);
+            if (_counts[i]++ == 0) _occupied.set(i);
+            ++_size;
+            if (_size == 1) {
+                _med = t;
+                _below = 0;
+                return;
+            }
+            if (t < _med) ++_below;
+            // нижняя медиана — значение с рангом (n - 1) / 2
+            const std::uint64_t rank = (_size - 1) / 2;
+            while (rank < _below) {
+                _med = prev_occupied(_med);
+                _below -= count_at(_med);
+            }
+            while (rank >= _below + count_at(_med)) {
+                _below += count_at(_med);
+                _med = next_occupied(_med);
+            }
+        }
+
+        /// То же, что add() для каждого значения по порядку
+        void add_batch(std::span<const T> values) {
+            for (T v : values) add(v);
+        }
+
+        /**
+         * \brief add_batch, сообщающий медиану после каждого значения.
+         * \param on_median вызывается как on_median(i, медиана после values[i])
+         */
+        template <class OnMedian>
+        void add_batch_and_emit(std::span<const T> values, OnMedian&& on_median) {
+            for (std::size_t i = 0; i < values.size(); ++i) {
+                add(values[i]);
+                on_median(i, current());
+            }
+        }
+
+        std::optional<T> median() const {
+            if (_size == 0) return std::nullopt;
+            return current();
+        }
+
+        std::uint64_t size() const noexcept { return _size; }
+
+        /// Сколько значений пришлось округлить до сетки (с создания или загрузки состояния)
+        std::uint64_t off_grid() const noexcept { return _off_grid; }
+
+        /// Размер массива счётчиков, тиков
+        std::size_t buckets() const noexcept { return _counts.size(); }
+
+        void reset() {
+            _counts.clear();
+            _occupied.clear();
+            _base = _med = 0;
+            _size = _below = _off_grid = 0;
+        }
+
+        /// Сохранение / восстановление состояния (архивы checkpoint.hpp); off_grid() считается заново в каждом запуске
+        template <class Archive>
+        void serialize_state(Archive& ar) {
+            ar & _tick & _counts & _base & _med & _size & _below;
+            if constexpr (Archive::is_loading) rebuild_occupancy();
+        }
+
+    private:
+        T current() const {
+            const T lo = value_of(_med);
+            if (_size % 2 == 1) return lo;
+            // верхняя медиана (ранг n / 2) — в том же тике или в следующем занятом
+            std::int64_t hi_tick = _med;
+            if (_size / 2 >= _below + count_at(_med)) hi_tick = next_occupied(_med);
+            const T hi = value_of(hi_tick);
+            if constexpr (std::is_integral_v<T>) {
+                return lo + (hi - lo) / 2;  // без переполнения, округление вниз
+            }
+            else {
+                return (lo + hi) / 2.0;
+            }
+        }
+
+        /// Номер ближайшего тика; NaN, бесконечность и |тик| > max_tick — std::out_of_range
+        std::int64_t tick_of(T v) {
+            if constexpr (std::is_integral_v<T>) {
+                // округление к ближайшему тику, половина — от нуля
+                const T q = v / _tick, r = v % _tick;
+                const T t = 2 * (r < 0 ? -r : r) >= _tick ? q + (r < 0 ? -1 : 1) : q;
+                if (t > max_tick || t < -max_tick) throw_out_of_range(v);
+                if (r != 0) ++_off_grid;
+                return static_cast<std::int64_t>(t);
+            }
+            else {
+                const double q = v / _tick;
+                // !(<=) отсекает и NaN; в этих пределах llround и арифметика тиков в grow() не переполняются
+                if (!(std::abs(q) <= static_cast<double>(max_tick))) throw_out_of_range(v);
+                const auto t = static_cast<std::int64_t>(std::llround(q));
+                if (std::abs(v - value_of(t)) > _tick * 1e-6) ++_off_grid;
+                return t;
+            }
+        }
+
+        T value_of(std::int64_t t) const {
+            if constexpr (std::is_integral_v<T>) {
+                return static_cast<T>(t) * _tick;
+            }
+            else {
+                return _per_unit != 0 ? static_cast<double>(t) / _per_unit : static_cast<double>(t) * _tick;
+            }
+        }
+
+        std::uint64_t count_at(std::int64_t t) const {
+            const std::int64_t i = t - _base;
+            return i >= 0 && i < static_cast<std::int64_t>(_counts.size()) ? _counts[static_cast<std::size_t>(i)] : 0;
+        }
+
+        [[noreturn]] static void throw_out_of_range(T v) {
+            char buf[32];
+            const auto end = std::to_chars(buf, buf + sizeof(buf), v).ptr;
+            throw std::out_of_range("Медиана по гистограмме: цена вне сетки тиков: " + std::string(buf, end));
+        }
+
+        /// Ближайший занятый тик выше t (должен существовать)
+        std::int64_t next_occupied(std::int64_t t) const {
+            return _base + static_cast<std::int64_t>(_occupied.next(static_cast<std::size_t>(t - _base) + 1));
+        }
+
+        /// Ближайший занятый тик ниже t (должен существовать)
+        std::int64_t prev_occupied(std::int64_t t) const {
+            return _base + static_cast<std::int64_t>(_occupied.prev(static_cast<std::size_t>(t - _base) - 1));
+        }
+
+        void rebuild_occupancy() {
+            _occupied.assign(_counts.size());
+            for (std::size_t i = 0; i < _counts.size(); ++i) {
+                if (_counts[i] != 0) _occupied.set(i);
+            }
+        }
+
+        /// Расширяет массив, чтобы в него попал тик t (с запасом в половину размера)
+        void grow(std::int64_t t) {
+            if (_counts.empty()) {
+                _base = t - static_cast<std::int64_t>(min_buckets / 2);
+                _counts.assign(min_buckets, 0);
+                _occupied.assign(min_buckets);
+                return;
+            }
+            const std::int64_t end = _base + static_cast<std::int64_t>(_counts.size());
+            const std::int64_t limit = static_cast<std::int64_t>(max_buckets);
+            const std::int64_t needed = std::max(t + 1, end) - std::min(t, _base);
+            if (needed > limit) {
+                throw std::length_error("Медиана по гистограмме: диапазон цен шире "
+                    + std::to_string(max_buckets) + " тиков, увеличьте median.tick_size");
+            }
+            const std::int64_t slack = std::min(limit - needed, std::max<std::int64_t>(
+                static_cast<std::int64_t>(_counts.size() / 2), static_cast<std::int64_t>(min_buckets)));
+            const std::int64_t new_base = t < _base ? t - slack : _base;
+            const std::int64_t new_end = t >= end ? t + 1 + slack : end;
+            std::vector<std::uint64_t> counts(static_cast<std::size_t>(new_end - new_base), 0);
+            std::copy(_counts.begin(), _counts.end(), counts.begin() + (_base - new_base));
+            _counts.swap(counts);
+            _base = new_base;
+            rebuild_occupancy();
+        }
+
+    private:
+        static constexpr std::size_t min_buckets = 1024;
+        static constexpr std::int64_t max_tick = std::int64_t(1) << 62;  ///< наибольший |номер тика|
+
+        T _tick;
+        double _per_unit = 0;                ///< 1 / tick_size, если оно целое (только для double)
+        std::vector<std::uint64_t> _counts;  ///< число значений на тик, индекс — тик - _base
+        detail::tick_occupancy _occupied;    ///< индексы _counts с ненулевым счётчиком
+        std::int64_t _base = 0;              ///< тик первого счётчика
+        std::int64_t _med = 0;               ///< тик нижней медианы
+        std::uint64_t _size = 0;
+        std::uint64_t _below = 0;            ///< значений в тиках ниже _med
+        std::uint64_t _off_grid = 0;
+    };
+
+}  // namespace median
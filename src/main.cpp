@@ -6,20 +6,37 @@
  *  - парсинг аргументов командной строки (Boost.Program_options)
  *  - поиск и чтение конфигурации (toml++)
  *  - сканирование директории, чтение CSV (csv_reader.hpp)
- *  - сортировка по receive_ts и инкрементальный расчёт медианы (median_calculator.hpp)
- *  - запись результата в CSV (только при изменении медианы)
+ *  - сортировка по receive_ts и инкрементальный расчёт медианы:
+ *    P^2 (median_calculator.hpp), точный на двух кучах (exact_median.hpp),
+ *    в скользящем окне по receive_ts (window_median.hpp) или по гистограмме тиков (histogram_median.hpp)
+ *  - либо потоковый режим: чтение, слияние, расчёт и запись одновременно (streaming.hpp)
+ *  - запись результата в CSV (только при изменении медианы, по желанию — одна строка на receive_ts; result_writer.hpp),
+ *    по желанию с колонками квантилей, min/max/mean и VWAP (quantile_stats.hpp)
+ *  - двоичный кэш разобранных файлов для повторных запусков (parse_cache.hpp)
+ *  - инкрементальные запуски с контрольной точкой (checkpoint.hpp)
+ *  - слежение за дописыванием входных файлов в реальном времени (--follow, follow.hpp)
+ *  - группировка по ключу из имени файла или колонки: файл результата на ключ (group_by.hpp)
+ *  - время и пропускная способность стадий, пиковая память, JSON с метриками (metrics.hpp)
  */
 
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <vector>
+#include <span>
 #include <filesystem>
 #include <algorithm>
 #include <iomanip>
+#include <cstdint>
+#include <limits>
+#include <cmath>
+#include <chrono>
+#include <unordered_map>
+#include <numeric>
+#include <type_traits>
 
 #include <boost/program_options.hpp>
- // Подключаем headers Boost.Accumulators, чтобы удовлетворить требование (включён, но в текущей реализации медиана — две кучи).
+ // Boost.Accumulators: оценка P^2 (median_calculator.hpp); точная медиана на двух кучах — exact_median.hpp
 #include <boost/accumulators/accumulators.hpp>
 
 #include <spdlog/spdlog.h>
@@ -28,6 +45,16 @@
 #include "config_parser.hpp"
 #include "csv_reader.hpp"
 #include "median_calculator.hpp"
+#include "exact_median.hpp"
+#include "window_median.hpp"
+#include "histogram_median.hpp"
+#include "streaming.hpp"
+#include "result_writer.hpp"
+#include "group_by.hpp"
+#include "quantile_stats.hpp"
+#include "checkpoint.hpp"
+#include "follow.hpp"
+#include "metrics.hpp"
 
 #if defined(_WIN32)
 #include <windows.h>
@@ -67,6 +94,987 @@ static fs::path get_executable_dir() {
     }
 }
 
+/// Политики записи результата (main.emit): выбираются один раз при компиляции
+namespace emit {
+    /// Строка после каждой строки входа, изменившей медиану
+    struct each_row {};
+    /// Не больше одной строки на группу строк с общим receive_ts
+    struct each_timestamp {};
+}  // namespace emit
+
+/**
+ * \brief Инкрементальный расчёт медианы с записью только её изменений.
+ *
+ * Строки результата дописываются в буфер buf; вызывающий сам решает,
+ * когда отдать его на запись. Если заданы дополнительные статистики, строка
+ * пишется при изменении медианы или любой из них.
+ *
+ * С политикой emit::each_timestamp медиана запрашивается один раз на группу строк с общим
+ * receive_ts, после всех её обновлений: не больше одной строки результата на метку.
+ * Группа на конце порции остаётся открытой до строки с другой меткой или finish().
+ * \tparam Calc движок медианы: basic_median_calculator, exact_median_calculator
+ *         или window_median_calculator (ему дополнительно передаётся receive_ts)
+ * \tparam Emit emit::each_row или emit::each_timestamp
+ */
+template <class Calc, class Emit>
+struct median_emitter {
+    Calc calc;
+    using value_type = typename Calc::value_type;
+
+    out::change_detector<value_type> last_median;
+    std::optional<median::stats_calculator<value_type>> stats;
+    std::vector<double> stat_values;
+    std::string extra, last_extra;  ///< поля статистик текущей и последней записанной строки
+    std::size_t changes_written = 0;
+    out::file_format file = out::file_format::csv;
+    static constexpr bool per_timestamp = std::is_same_v<Emit, emit::each_timestamp>;
+    bool group_open = false;        ///< строки с receive_ts group_ts добавлены, медиана ещё не запрошена
+    std::uint64_t group_ts = 0;
+
+    median_emitter(Calc c, const median::stats_spec& spec, out::file_format f = out::file_format::csv)
+        : calc(std::move(c)), file(f) {
+        if (!spec.empty()) stats.emplace(spec);
+    }
+
+    template <class Price>
+    void process(const csv::basic_record_store<Price>& rows, std::size_t begin, std::size_t end, std::string& buf) {
+        if constexpr (per_timestamp) {
+            process_groups(rows, begin, end, buf);
+            return;
+        }
+        if (!stats) {
+            // без статистик — блоком: движок не проверяет режим на каждой строке
+            const std::span<const Price> prices(rows.price.data() + begin, end - begin);
+            const auto emit = [&](std::size_t k, value_type median) {
+                if (last_median.update(median)) write_row(rows.receive_ts[begin + k], buf);
+            };
+            if constexpr (requires { calc.add(rows.receive_ts[begin], rows.price[begin]); }) {
+                calc.add_batch_and_emit(std::span<const std::uint64_t>(rows.receive_ts.data() + begin, end - begin),
+                    prices, emit);
+            }
+            else {
+                calc.add_batch_and_emit(prices, emit);
+            }
+            return;
+        }
+        for (std::size_t i = begin; i < end; ++i) {
+            add_rows(rows, i, i + 1);
+            emit_current(rows.receive_ts[i], buf);
+        }
+    }
+
+    /// Записывает медиану открытой группы (emit::each_timestamp); вызывается в конце данных
+    void finish(std::string& buf) {
+        if (!group_open) return;
+        group_open = false;
+        emit_current(group_ts, buf);
+    }
+
+    /// Сохранение / восстановление состояния для контрольной точки (с открытой группой emit::each_timestamp)
+    template <class Archive>
+    void serialize_state(Archive& ar) {
+        calc.serialize_state(ar);
+        last_median.serialize_state(ar);
+        ar & last_extra;
+        if (stats) stats->serialize_state(ar);
+        if constexpr (per_timestamp) ar & group_open & group_ts;
+    }
+
+private:
+    /// Строки [begin, end) — в движок и статистики
+    template <class Price>
+    void add_rows(const csv::basic_record_store<Price>& rows, std::size_t begin, std::size_t end) {
+        const std::span<const Price> prices(rows.price.data() + begin, end - begin);
+        if constexpr (requires { calc.add(rows.receive_ts[begin], rows.price[begin]); }) {
+            calc.add_batch(std::span<const std::uint64_t>(rows.receive_ts.data() + begin, end - begin), prices);
+        }
+        else {
+            calc.add_batch(prices);
+        }
+        if (stats) {
+            for (std::size_t i = begin; i < end; ++i) {
+                stats->add(rows.price[i], rows.quantity.empty() ? 0.0 : rows.quantity[i]);
+            }
+        }
+    }
+
+    /// Строки подряд с одним receive_ts добавляются вместе, медиана — при смене метки
+    template <class Price>
+    void process_groups(const csv::basic_record_store<Price>& rows, std::size_t begin, std::size_t end,
+        std::string& buf) {
+        for (std::size_t i = begin; i < end;) {
+            const std::uint64_t ts = rows.receive_ts[i];
+            if (group_open && ts != group_ts) finish(buf);
+            std::size_t j = i + 1;
+            while (j < end && rows.receive_ts[j] == ts) ++j;
+            add_rows(rows, i, j);
+            group_open = true;
+            group_ts = ts;
+            i = j;
+        }
+    }
+
+    /// Пишет строку с меткой ts, если медиана или статистики изменились
+    void emit_current(std::uint64_t ts, std::string& buf) {
+        auto med_opt = calc.median();
+        if (!med_opt) return;
+        bool changed = last_median.update(*med_opt);
+        if (stats) {
+            stats->values(stat_values);
+            extra.clear();
+            for (double v : stat_values) out::append_stat<value_type>(extra, v);
+            if (extra != last_extra) {
+                last_extra.swap(extra);
+                changed = true;
+            }
+        }
+        if (changed) write_row(ts, buf);
+    }
+
+    /// Дописывает строку результата с меткой ts: текст CSV или двоичную запись (out::file_format)
+    void write_row(std::uint64_t ts, std::string& buf) {
+        if (file == out::file_format::binary) {
+            out::append_binary_row(buf, ts, last_median.value(),
+                stats ? std::span<const double>(stat_values) : std::span<const double>());
+        }
+        else {
+            out::append_row(buf, ts, last_median.text(), last_extra);
+        }
+        ++changes_written;
+    }
+};
+
+/**
+ * \brief Создаёт директорию вывода.
+ * \return 0 при успехе, иначе код завершения процесса
+ */
+static int create_output_dir(const cfg::main_config_t& config) {
+    try {
+        fs::create_directories(config.output_dir);
+    }
+    catch (const std::exception& ex) {
+        spdlog::error("Не удалось создать директорию вывода {}: {}", config.output_dir.string(), ex.what());
+        return 4;
+    }
+    return 0;
+}
+
+/// Дополнительные статистики из секции [stats]
+static median::stats_spec make_stats_spec(const cfg::main_config_t& config) {
+    median::stats_spec spec;
+    spec.quantiles = config.stats.quantiles;
+    spec.min = config.stats.min;
+    spec.max = config.stats.max;
+    spec.mean = config.stats.mean;
+    spec.vwap = config.stats.vwap;
+    return spec;
+}
+
+/// Колонки входных файлов: имена из [columns], вес — для VWAP
+static csv::column_request make_column_request(const cfg::main_config_t& config) {
+    csv::column_request request;
+    request.ts_column = config.columns.timestamp;
+    request.price_column = config.columns.value;
+    request.quantity_column = config.columns.weight;
+    request.quantity = config.stats.vwap;
+    return request;
+}
+
+/**
+ * \brief Сводка пропущенных неверных строк (main.skip_invalid): число по видам и первые строки.
+ * \param paths пути в порядке file_id журнала
+ */
+static void report_skipped(const cfg::main_config_t& config, const csv::row_error_log& log,
+    const std::vector<fs::path>& paths) {
+    if (log.count == 0) return;
+    const auto request = make_column_request(config);
+    spdlog::warn("Пропущено неверных строк: {} ({})", log.count, log.kinds(request));
+    for (const auto& s : log.samples) spdlog::warn("  {}", log.describe(s, paths, request));
+    if (log.count > log.samples.size()) spdlog::warn("  ... и ещё {}", log.count - log.samples.size());
+    metrics::global().count("invalid_rows", log.count);
+}
+
+/// Где искать входные файлы: main.input, main.recursive, main.filename_mask
+static csv::input_spec make_input_spec(const cfg::main_config_t& config) {
+    return csv::input_spec{ config.input_dirs, config.filename_mask, config.recursive };
+}
+
+/// Входные директории через запятую (для лога)
+static std::string input_dirs_text(const cfg::main_config_t& config) {
+    std::vector<std::string> dirs;
+    for (const auto& dir : config.input_dirs) dirs.push_back(dir.string());
+    return fmt::format("{}", fmt::join(dirs, ","));
+}
+
+/// Формат файла результата: main.output_format, main.output_page_align
+static out::result_format make_result_format(const cfg::main_config_t& config) {
+    out::result_format format;
+    format.file = config.output_format == cfg::output_format_t::binary ? out::file_format::binary : out::file_format::csv;
+    format.page_align = config.output_page_align;
+    return format;
+}
+
+/**
+ * \brief Открывает файл результата и пишет заголовок (с колонками статистик spec).
+ * \tparam Price тип цены: задаёт тип полей двоичного формата
+ * \return 0 при успехе, иначе код завершения процесса
+ */
+template <class Price>
+static int open_output(const fs::path& out_path, const median::stats_spec& spec, const out::result_format& format,
+    std::ofstream& ofs) {
+    ofs.open(out_path, std::ios::out | std::ios::trunc | std::ios::binary);
+    if (!ofs.is_open()) {
+        spdlog::error("Не удалось открыть файл для записи: {}", out_path.string());
+        return 5;
+    }
+    if (format.file == out::file_format::binary) {
+        const auto header = out::make_binary_header<Price>(spec.column_names(), format.page_align);
+        ofs.write(header.data(), static_cast<std::streamsize>(header.size()));
+        return 0;
+    }
+    ofs << "receive_ts;price_median";
+    for (const auto& name : spec.column_names()) ofs << ';' << name;
+    ofs << '\n';
+    return 0;
+}
+
+/// Упорядочивание записей по receive_ts выбранной стратегией
+template <class Price>
+static void sort_records(const cfg::main_config_t& config, csv::basic_record_store<Price>& records,
+    par::thread_pool& pool) {
+    if (config.sort == cfg::sort_strategy_t::merge) {
+        records.merge_by_time(pool);
+    }
+    else {
+        records.sort_by_time(pool);
+    }
+}
+
+/// Предупреждение о ценах, округлённых до сетки median.tick_size (движок histogram)
+template <class Calc>
+static void report_off_grid(const Calc& calc) {
+    if constexpr (requires { calc.off_grid(); }) {
+        if (calc.off_grid() == 0) return;
+        spdlog::warn("Цен вне сетки median.tick_size: {}, они округлены до ближайшего тика", calc.off_grid());
+        metrics::global().count("off_grid_values", calc.off_grid());
+    }
+}
+
+/// Секунды из длительности steady_clock
+static double seconds_of(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double>(d).count();
+}
+
+/**
+ * \brief Пропускает упорядоченные записи через emitter и пишет изменения в ofs блоками.
+ * \param m если задан — время расчёта (стадия median) и записи (стадия write)
+ * \param close_group записать и последнюю группу receive_ts (emit::each_timestamp); false — она
+ *        остаётся открытой в emitter, к ней могут добавиться строки следующего запуска
+ * \return false при ошибке записи
+ */
+template <class Price, class Calc, class Emit>
+static bool emit_records(const csv::basic_record_store<Price>& records, median_emitter<Calc, Emit>& emitter,
+    std::ofstream& ofs, metrics::run_metrics* m = nullptr, bool close_group = true) {
+    using clock = std::chrono::steady_clock;
+    out::block_writer writer(ofs);
+    constexpr std::size_t slice = 65536;
+    const std::size_t changes_before = emitter.changes_written;
+    clock::duration calc_time{}, write_time{};
+    for (std::size_t i = 0; i < records.size(); i += slice) {
+        const auto t0 = clock::now();
+        emitter.process(records, i, std::min(records.size(), i + slice), writer.buffer());
+        const auto t1 = clock::now();
+        writer.maybe_flush();
+        calc_time += t1 - t0;
+        write_time += clock::now() - t1;
+    }
+    const auto t2 = clock::now();
+    if (close_group) emitter.finish(writer.buffer());
+    const auto t3 = clock::now();
+    calc_time += t3 - t2;
+    const bool ok = writer.flush();
+    write_time += clock::now() - t3;
+    if (m) {
+        m->add("median", seconds_of(calc_time), records.size());
+        m->add("write", seconds_of(write_time), emitter.changes_written - changes_before, writer.bytes_written());
+    }
+    return ok;
+}
+
+/**
+ * \brief Расчёт медианы по упорядоченным записям и запись изменений в out_path.
+ * \tparam Emit политика записи (emit::each_row / emit::each_timestamp)
+ * \param changes_written число записанных изменений медианы
+ * \param m если задан — куда добавить время расчёта и записи
+ * \return 0 при успехе, иначе код завершения процесса
+ */
+template <class Price, class Emit, class Calc>
+static int write_medians(const csv::basic_record_store<Price>& records, const fs::path& out_path, Calc calc,
+    const median::stats_spec& spec, const out::result_format& format, std::size_t& changes_written,
+    metrics::run_metrics* m = nullptr) {
+    std::ofstream ofs;
+    if (int rc = open_output<Price>(out_path, spec, format, ofs)) return rc;
+
+    median_emitter<Calc, Emit> emitter(std::move(calc), spec, format.file);
+    const bool write_ok = emit_records(records, emitter, ofs, m);
+    ofs.close();
+    changes_written = emitter.changes_written;
+    report_off_grid(emitter.calc);
+    if (!write_ok) {
+        spdlog::error("Ошибка записи в {}", out_path.string());
+        return 5;
+    }
+    return 0;
+}
+
+/// Отпечаток настроек, от которых зависит сохранённое состояние расчёта
+static std::string config_fingerprint(const cfg::main_config_t& config) {
+    ckpt::writer w;
+    w & config.price_format & config.emit & config.median.engine & config.median.seed_threshold
+        & config.median.window_us & config.median.window_ticks & config.median.tick_size
+        & config.stats.quantiles & config.stats.min & config.stats.max & config.stats.mean & config.stats.vwap
+        & config.columns.timestamp & config.columns.value & config.columns.weight
+        & config.output_format & config.output_page_align;
+    return w.data();
+}
+
+/**
+ * \brief Инкрементальный запуск: продолжение с контрольной точки main.checkpoint.
+ *
+ * Разбираются только строки, дописанные после прошлого запуска (и новые файлы);
+ * новые изменения медианы дописываются в конец файла результата. Новые строки
+ * не должны быть старше последнего обработанного receive_ts — иначе результат
+ * отличался бы от полного пересчёта, и запуск завершается ошибкой.
+ * С emit::each_timestamp последняя группа receive_ts не записывается, а сохраняется
+ * открытой в контрольной точке: строки с той же меткой, дописанные позже, попадут
+ * в неё, и строка для метки будет одна, как при полном пересчёте.
+ * \return код завершения процесса
+ */
+template <class Price, class Emit, class Calc>
+static int run_incremental(const cfg::main_config_t& config, par::thread_pool& pool, Calc calc) {
+    const auto spec = make_stats_spec(config);
+    const auto fingerprint = config_fingerprint(config);
+    const auto format = make_result_format(config);
+    const fs::path out_path = config.output_dir / format.file_name();
+    median_emitter<Calc, Emit> emitter(std::move(calc), spec, format.file);
+    std::vector<ckpt::file_cursor> cursors;
+    std::uint64_t last_ts = 0;
+    bool resumed = false;
+
+    // ---- Восстановление состояния ----
+    if (fs::exists(config.checkpoint)) {
+        std::optional<ckpt::reader> ar;
+        if (auto err = ckpt::load_file(config.checkpoint, fingerprint, ar)) {
+            spdlog::error("Ошибка контрольной точки: {}", *err);
+            return 6;
+        }
+        *ar & cursors & last_ts;
+        emitter.serialize_state(*ar);
+        if (!ar->ok() || !ar->at_end()) {
+            spdlog::error("Ошибка контрольной точки: файл повреждён: {}", config.checkpoint.string());
+            return 6;
+        }
+        if (!fs::exists(out_path)) {
+            spdlog::error("Ошибка контрольной точки: нет файла результата {} для продолжения", out_path.string());
+            return 6;
+        }
+        resumed = true;
+        spdlog::info("Продолжение с контрольной точки {}: файлов {}, последний receive_ts {}",
+            config.checkpoint.string(), cursors.size(), last_ts);
+    }
+
+    // ---- Чтение новых строк ----
+    std::vector<fs::path> paths;
+    if (auto err = csv::find_csv_files(make_input_spec(config), paths, pool)) {
+        spdlog::error("Ошибка чтения CSV: {}", *err);
+        return 3;
+    }
+    csv::read_options options;
+    options.columns = make_column_request(config);
+    options.read_ahead_bytes = config.read_ahead_mb << 20;
+    options.skip_invalid = config.skip_invalid;
+    options.max_errors = config.max_errors;
+    options.complete_lines_only = true;
+    options.start.resize(paths.size());
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        const auto it = std::find_if(cursors.begin(), cursors.end(),
+            [&](const ckpt::file_cursor& c) { return c.path == paths[i].string(); });
+        if (it != cursors.end()) options.start[i] = { it->offset, it->line };
+    }
+    csv::basic_record_store<Price> records;
+    csv::read_summary summary;
+    metrics::stage_timer read_timer("read");
+    if (auto err = csv::read_csv_paths(paths, records, pool, options, &summary)) {
+        spdlog::error("Ошибка чтения CSV: {}", *err);
+        return 3;
+    }
+    read_timer.set_rows(records.size());
+    read_timer.set_bytes(summary.bytes);
+    read_timer.stop();
+    metrics::global().count("files", paths.size());
+    report_skipped(config, summary.skipped, paths);
+    spdlog::info("Новых записей: {}", records.size());
+    {
+        metrics::stage_timer sort_timer("sort");
+        sort_timer.set_rows(records.size());
+        sort_records(config, records, pool);
+    }
+    if (resumed && !records.empty() && records.receive_ts.front() < last_ts) {
+        spdlog::error("Новые строки старше контрольной точки (receive_ts {} < {}); "
+            "для полного пересчёта удалите {}", records.receive_ts.front(), last_ts, config.checkpoint.string());
+        return 3;
+    }
+
+    // ---- Дописывание результата ----
+    if (int rc = create_output_dir(config)) return rc;
+    std::ofstream ofs;
+    if (resumed) {
+        ofs.open(out_path, std::ios::out | std::ios::app | std::ios::binary);
+        if (!ofs.is_open()) {
+            spdlog::error("Не удалось открыть файл для записи: {}", out_path.string());
+            return 5;
+        }
+    }
+    else if (int rc = open_output<Price>(out_path, spec, format, ofs)) {
+        return rc;
+    }
+    const std::size_t changes_before = emitter.changes_written;
+    const bool write_ok = emit_records(records, emitter, ofs, &metrics::global(), false);
+    ofs.close();
+    if (!write_ok) {
+        spdlog::error("Ошибка записи в {}", out_path.string());
+        return 5;
+    }
+
+    // ---- Новая контрольная точка ----
+    if (!records.empty()) last_ts = records.receive_ts.back();
+    cursors.clear();
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        cursors.push_back({ paths[i].string(), summary.ends[i].offset, summary.ends[i].line });
+    }
+    metrics::stage_timer ckpt_timer("checkpoint");
+    ckpt::writer w;
+    w & cursors & last_ts;
+    emitter.serialize_state(w);
+    ckpt_timer.set_bytes(w.data().size());
+    if (auto err = ckpt::save_file(config.checkpoint, fingerprint, w)) {
+        spdlog::error("Ошибка контрольной точки: {}", *err);
+        return 6;
+    }
+    ckpt_timer.stop();
+    metrics::global().count("changes_written", emitter.changes_written - changes_before);
+    report_off_grid(emitter.calc);
+    spdlog::info("Дописано изменений медианы: {} в {}", emitter.changes_written - changes_before, out_path.string());
+    spdlog::info("Готово.");
+    return 0;
+}
+
+/**
+ * \brief Режим слежения: после первого прохода ждёт дописывания известных файлов
+ *        и появления новых по маске, изменения медианы пишутся сразу.
+ *
+ * Строки разных файлов упорядочиваются по receive_ts в окне follow.reorder_us
+ * (follow.hpp); строки старше уже обработанных отбрасываются с предупреждением.
+ * Разбираются только завершённые строки. Работа завершается по SIGINT / SIGTERM:
+ * накопленные строки досчитываются, файл результата закрывается.
+ * \return код завершения процесса
+ */
+template <class Price, class Emit, class Calc>
+static int run_follow(const cfg::main_config_t& config, par::thread_pool& pool, Calc calc) {
+    using clock = std::chrono::steady_clock;
+    follow::dir_watcher watcher;
+    if (auto err = watcher.open(config.input_dirs, config.recursive)) {
+        spdlog::error("Ошибка слежения: {}", *err);
+        return 3;
+    }
+    follow::install_stop_handlers();
+
+    if (int rc = create_output_dir(config)) return rc;
+    const auto format = make_result_format(config);
+    const fs::path out_path = config.output_dir / format.file_name();
+    const auto spec = make_stats_spec(config);
+    std::ofstream ofs;
+    if (int rc = open_output<Price>(out_path, spec, format, ofs)) return rc;
+    ofs.flush();
+
+    median_emitter<Calc, Emit> emitter(std::move(calc), spec, format.file);
+    follow::reorder_buffer<Price> reorder(config.follow.reorder_us);
+    csv::basic_record_store<Price> rows, ready;
+    std::string buf;
+    // Пропускает через расчёт строки, вышедшие из окна переупорядочивания; false — ошибка записи.
+    // Последняя группа receive_ts (emit::each_timestamp) записывается только при close_group — при
+    // завершении: после простоя могут прийти строки с той же меткой, они должны попасть в ту же группу
+    const auto emit_ready = [&](bool all, bool close_group = false) {
+        reorder.release(ready, all);
+        if (ready.empty() && !(close_group && emitter.group_open)) return true;
+        const auto changes_before = emitter.changes_written;
+        const auto t0 = clock::now();
+        buf.clear();
+        emitter.process(ready, 0, ready.size(), buf);
+        if (close_group) emitter.finish(buf);
+        const auto t1 = clock::now();
+        ofs.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+        ofs.flush();
+        metrics::global().add("median", seconds_of(t1 - t0), ready.size());
+        metrics::global().add("write", seconds_of(clock::now() - t1), emitter.changes_written - changes_before, buf.size());
+        return static_cast<bool>(ofs);
+    };
+
+    // известные файлы: индекс — file_id за всё время слежения
+    std::vector<fs::path> known;
+    std::unordered_map<std::string, std::size_t> known_index;
+    std::vector<csv::file_position> positions;
+    std::vector<std::uintmax_t> seen_size;
+
+    csv::read_options options;
+    options.columns = make_column_request(config);
+    options.read_ahead_bytes = config.read_ahead_mb << 20;
+    options.skip_invalid = config.skip_invalid;
+    options.max_errors = config.max_errors;
+    options.complete_lines_only = true;
+    std::vector<fs::path> found, changed;
+    std::vector<std::size_t> changed_id;
+    csv::read_summary summary;
+    std::size_t rows_read = 0, late_reported = 0;
+    bool first_pass = true;
+    int rc = 0;
+    auto last_data = clock::now();
+
+    spdlog::info("Слежение за {}: окно переупорядочивания {} мкс, опрос {} мс",
+        input_dirs_text(config), config.follow.reorder_us, config.follow.poll_ms);
+    for (;;) {
+        // ---- новые и выросшие файлы ----
+        if (auto err = csv::find_csv_files(make_input_spec(config), found, pool)) {
+            spdlog::error("Ошибка чтения CSV: {}", *err);
+            rc = 3;
+            break;
+        }
+        changed.clear();
+        changed_id.clear();
+        options.start.clear();
+        const std::size_t known_before = known.size();
+        for (const auto& path : found) {
+            auto [it, added] = known_index.try_emplace(path.string(), known.size());
+            if (added) {
+                if (known.size() > std::numeric_limits<csv::file_id_t>::max()) {
+                    spdlog::error("Ошибка чтения CSV: Слишком много входных файлов: {}", known.size() + 1);
+                    rc = 3;
+                    break;
+                }
+                known.push_back(path);
+                positions.emplace_back();
+                seen_size.push_back(0);
+            }
+            const std::size_t id = it->second;
+            std::error_code ec;
+            const auto size = fs::file_size(path, ec);
+            if (ec || size == seen_size[id]) continue;
+            seen_size[id] = size;
+            changed.push_back(path);
+            changed_id.push_back(id);
+            options.start.push_back(positions[id]);
+        }
+        if (rc) break;
+        if (known.size() != known_before) {
+            // при равных receive_ts — порядок путей, как у file_id пакетного режима, а не порядок появления
+            std::vector<std::size_t> by_path(known.size());
+            std::iota(by_path.begin(), by_path.end(), std::size_t(0));
+            std::sort(by_path.begin(), by_path.end(),
+                [&](std::size_t a, std::size_t b) { return known[a].string() < known[b].string(); });
+            std::vector<csv::file_id_t> rank(known.size());
+            for (std::size_t k = 0; k < by_path.size(); ++k) rank[by_path[k]] = static_cast<csv::file_id_t>(k);
+            reorder.set_file_order(std::move(rank));
+        }
+        if (!changed.empty()) {
+            metrics::stage_timer read_timer("read");
+            if (auto err = csv::read_csv_paths(changed, rows, pool, options, &summary)) {
+                spdlog::error("Ошибка чтения CSV: {}", *err);
+                rc = 3;
+                break;
+            }
+            read_timer.set_rows(rows.size());
+            read_timer.set_bytes(summary.bytes);
+            for (std::size_t k = 0; k < changed.size(); ++k) positions[changed_id[k]] = summary.ends[k];
+            report_skipped(config, summary.skipped, changed);
+            for (auto& fid : rows.file_id) fid = static_cast<csv::file_id_t>(changed_id[fid]);
+            if (!rows.empty()) last_data = clock::now();
+            rows_read += rows.size();
+            reorder.push(rows);
+        }
+        if (first_pass) {
+            spdlog::info("Первый проход: файлов {}, записей {}", known.size(), rows_read);
+            first_pass = false;
+        }
+
+        // ---- расчёт и запись ----
+        const bool idle = config.follow.idle_flush_ms != 0
+            && clock::now() - last_data >= std::chrono::milliseconds(config.follow.idle_flush_ms);
+        if (!emit_ready(idle || follow::stop_requested())) {
+            spdlog::error("Ошибка записи в {}", out_path.string());
+            return 5;
+        }
+        if (reorder.late() != late_reported) {
+            spdlog::warn("Отброшено строк старше уже обработанных: {} (всего {})",
+                reorder.late() - late_reported, reorder.late());
+            late_reported = reorder.late();
+        }
+        if (follow::stop_requested()) break;
+        watcher.wait(std::chrono::milliseconds(config.follow.poll_ms));
+    }
+
+    if (!emit_ready(true, true)) {
+        spdlog::error("Ошибка записи в {}", out_path.string());
+        return 5;
+    }
+    ofs.close();
+    metrics::global().count("files", known.size());
+    metrics::global().count("late_rows", reorder.late());
+    metrics::global().count("changes_written", emitter.changes_written);
+    report_off_grid(emitter.calc);
+    spdlog::info("Слежение завершено. Прочитано записей: {}, отброшено опоздавших: {}", rows_read, reorder.late());
+    spdlog::info("Записано изменений медианы: {} в {}", emitter.changes_written, out_path.string());
+    return rc;
+}
+
+/**
+ * \brief Группировка: отдельная медиана и отдельный файл результата на каждый ключ.
+ *
+ * Группы сортируются и считаются параллельно на pool, каждая в одном потоке.
+ * \return код завершения процесса
+ */
+template <class Price, class Emit, class Calc>
+static int run_grouped(const cfg::main_config_t& config, par::thread_pool& pool,
+    csv::basic_record_store<Price>& records, const Calc& calc) {
+    if (config.group.by == cfg::group_by_t::file) {
+        if (auto err = group::assign_file_keys(records, config.group.pattern)) {
+            spdlog::error("Ошибка группировки: {}", *err);
+            return 3;
+        }
+    }
+    metrics::stage_timer split_timer("group_split");
+    split_timer.set_rows(records.size());
+    auto parts = group::split_by_group(records, pool);
+    records = {};
+    split_timer.stop();
+    const auto spec = make_stats_spec(config);
+    const auto format = make_result_format(config);
+    spdlog::info("Групп: {}", parts.size());
+
+    std::vector<std::string> keys;
+    std::vector<fs::path> out_paths;
+    for (const auto& part : parts) {
+        keys.push_back(part.groups.names.front());
+        auto path = config.output_dir / group::output_name(keys.back(),
+            format.file == out::file_format::binary ? ".bin" : ".csv");
+        if (std::find(out_paths.begin(), out_paths.end(), path) != out_paths.end()) {
+            spdlog::error("Ошибка группировки: ключи дают одинаковое имя файла {}", path.string());
+            return 3;
+        }
+        out_paths.push_back(std::move(path));
+    }
+    if (int rc = create_output_dir(config)) return rc;
+
+    std::vector<std::size_t> rows(parts.size()), changes(parts.size());
+    std::vector<int> rcs(parts.size(), 0);
+    // группы считаются параллельно: время стадии — общее, без разбиения на сортировку и расчёт
+    metrics::stage_timer compute_timer("group_compute");
+    pool.parallel_for(parts.size(), [&](std::size_t g) {
+        auto& part = parts[g];
+        par::thread_pool serial(1);
+        sort_records(config, part, serial);
+        rows[g] = part.size();
+        rcs[g] = write_medians<Price, Emit>(part, out_paths[g], calc, spec, format, changes[g]);
+        part = {};
+    });
+    compute_timer.set_rows(std::accumulate(rows.begin(), rows.end(), std::size_t(0)));
+    compute_timer.stop();
+    metrics::global().count("groups", parts.size());
+    metrics::global().count("changes_written", std::accumulate(changes.begin(), changes.end(), std::size_t(0)));
+
+    for (std::size_t g = 0; g < parts.size(); ++g) {
+        if (rcs[g]) return rcs[g];
+        spdlog::info("Группа {}: записей {}, изменений медианы {} в {}",
+            keys[g], rows[g], changes[g], out_paths[g].string());
+    }
+    spdlog::info("Готово.");
+    return 0;
+}
+
+/**
+ * \brief Пакетный режим: чтение всех файлов, сортировка, расчёт медианы и запись результата.
+ * \tparam Price тип цены: double или std::int64_t (фиксированная точка)
+ * \tparam Emit политика записи (emit::each_row / emit::each_timestamp)
+ * \tparam Calc движок медианы
+ * \return код завершения процесса
+ */
+template <class Price, class Emit, class Calc>
+static int run_batch(const cfg::main_config_t& config, par::thread_pool& pool, Calc calc) {
+    if (!config.checkpoint.empty()) {
+        return run_incremental<Price, Emit>(config, pool, std::move(calc));
+    }
+
+    // ---- Чтение CSV файлов ----
+    csv::basic_record_store<Price> records;
+    csv::read_options options;
+    options.columns = make_column_request(config);
+    options.read_ahead_bytes = config.read_ahead_mb << 20;
+    options.skip_invalid = config.skip_invalid;
+    options.max_errors = config.max_errors;
+    if (config.group.by == cfg::group_by_t::column) options.columns.key_column = config.group.column;
+    options.cache = config.cache;
+    options.cache_dir = config.cache_dir;
+    csv::read_summary summary;
+    metrics::stage_timer read_timer("read");
+    auto read_err = csv::read_csv_files(make_input_spec(config), records, pool, options, &summary);
+    if (read_err) {
+        spdlog::error("Ошибка чтения CSV: {}", *read_err);
+        return 3;
+    }
+    read_timer.set_rows(records.size());
+    read_timer.set_bytes(summary.bytes);
+    read_timer.stop();
+    metrics::global().count("files", records.files.size());
+    report_skipped(config, summary.skipped, records.files);
+    if (config.cache) {
+        metrics::global().count("cache_hits", summary.cache_hits);
+        spdlog::info("Кэш разбора: загружено файлов {}, записано {}", summary.cache_hits, summary.cache_writes);
+    }
+
+    spdlog::info("Прочитано записей: {}", records.size());
+    if (records.empty()) {
+        spdlog::warn("Нет записей для обработки. Завершение.");
+        return 0;
+    }
+
+    if (config.group.by != cfg::group_by_t::none) {
+        return run_grouped<Price, Emit>(config, pool, records, calc);
+    }
+
+    // ---- Сортировка по receive_ts (и tie-breaker по файлу/строке) ----
+    if (config.sort == cfg::sort_strategy_t::merge) {
+        spdlog::info("Слияние {} файлов, из них не упорядочены по receive_ts: {}",
+            records.runs.size(), records.unsorted_runs());
+    }
+    {
+        metrics::stage_timer sort_timer("sort");
+        sort_timer.set_rows(records.size());
+        sort_records(config, records, pool);
+    }
+
+    // ---- Инкрементальный расчёт медианы и запись результата ----
+    if (int rc = create_output_dir(config)) return rc;
+    const auto format = make_result_format(config);
+    const fs::path out_path = config.output_dir / format.file_name();
+    std::size_t changes_written = 0;
+    if (int rc = write_medians<Price, Emit>(records, out_path, std::move(calc), make_stats_spec(config), format,
+        changes_written, &metrics::global())) {
+        return rc;
+    }
+    metrics::global().count("changes_written", changes_written);
+    spdlog::info("Записано изменений медианы: {} в {}", changes_written, out_path.string());
+    spdlog::info("Готово.");
+    return 0;
+}
+
+/**
+ * \brief Потоковый режим: чтение, слияние, расчёт и запись идут одновременно
+ *        через ограниченные очереди (streaming.hpp), память не растёт с объёмом данных.
+ * \return код завершения процесса
+ */
+template <class Price, class Emit, class Calc>
+static int run_stream(const cfg::main_config_t& config, par::thread_pool& pool, Calc calc) {
+    std::vector<fs::path> paths;
+    if (auto err = csv::find_csv_files(make_input_spec(config), paths, pool)) {
+        spdlog::error("Ошибка чтения CSV: {}", *err);
+        return 3;
+    }
+    if (paths.size() > std::size_t(std::numeric_limits<csv::file_id_t>::max()) + 1) {
+        spdlog::error("Ошибка чтения CSV: Слишком много входных файлов: {}", paths.size());
+        return 3;
+    }
+
+    stream::stream_options options;
+    options.threads = pool.size();
+    options.columns = make_column_request(config);
+    options.read_ahead_bytes = config.read_ahead_mb << 20;
+    options.skip_invalid = config.skip_invalid;
+    options.max_errors = config.max_errors;
+    stream::merged_reader<Price> reader;
+    if (auto err = reader.open(paths, options)) {
+        spdlog::error("Ошибка чтения CSV: {}", *err);
+        return 3;
+    }
+    spdlog::info("Потоковый режим: файлов {}, строк в порции {}", paths.size(), reader.batch_rows());
+
+    if (int rc = create_output_dir(config)) return rc;
+    const auto format = make_result_format(config);
+    const fs::path out_path = config.output_dir / format.file_name();
+    const auto spec = make_stats_spec(config);
+    std::ofstream ofs;
+    if (int rc = open_output<Price>(out_path, spec, format, ofs)) return rc;
+    ofs.flush();
+
+    median_emitter<Calc, Emit> emitter(std::move(calc), spec, format.file);
+    std::size_t rows_read = 0;
+    bool write_ok = true;
+    {
+        // стадии идут одновременно: отдельно видно только время расчёта и ожидания соседних стадий
+        using clock = std::chrono::steady_clock;
+        clock::duration calc_time{}, read_wait{}, write_wait{};
+        std::uint64_t bytes_out = 0;
+        metrics::stage_timer pipeline_timer("stream");
+        stream::async_writer writer(ofs);
+        csv::basic_record_store<Price> batch;
+        for (;;) {
+            const auto t0 = clock::now();
+            if (!reader.next(batch)) break;
+            const auto t1 = clock::now();
+            rows_read += batch.size();
+            std::string chunk;
+            emitter.process(batch, 0, batch.size(), chunk);
+            const auto t2 = clock::now();
+            bytes_out += chunk.size();
+            writer.write(std::move(chunk));
+            read_wait += t1 - t0;
+            calc_time += t2 - t1;
+            write_wait += clock::now() - t2;
+        }
+        const auto t3 = clock::now();
+        std::string tail;
+        emitter.finish(tail);
+        bytes_out += tail.size();
+        writer.write(std::move(tail));
+        write_ok = writer.finish();
+        write_wait += clock::now() - t3;
+
+        std::uint64_t bytes_in = 0;
+        for (const auto& p : paths) {
+            std::error_code ec;
+            const auto size = fs::file_size(p, ec);
+            if (!ec) bytes_in += size;
+        }
+        pipeline_timer.set_rows(rows_read);
+        pipeline_timer.set_bytes(bytes_in);
+        pipeline_timer.stop();
+        auto& m = metrics::global();
+        m.add("median", seconds_of(calc_time), rows_read);
+        m.add("wait_read", seconds_of(read_wait));
+        m.add("wait_write", seconds_of(write_wait), emitter.changes_written, bytes_out);
+        m.count("files", paths.size());
+        m.count("changes_written", emitter.changes_written);
+        report_off_grid(emitter.calc);
+    }
+    ofs.close();
+    if (!write_ok) {
+        spdlog::error("Ошибка записи в {}", out_path.string());
+        return 5;
+    }
+
+    spdlog::info("Прочитано записей: {}", rows_read);
+    spdlog::info("Записано изменений медианы: {} в {}", emitter.changes_written, out_path.string());
+    report_skipped(config, reader.skipped(), paths);
+    if (reader.error()) {
+        spdlog::error("Ошибка чтения CSV: {}", *reader.error());
+        return 3;
+    }
+    spdlog::info("Готово.");
+    return 0;
+}
+
+/**
+ * \brief Слежение (--follow), пакетный или потоковый режим — по main.pipeline.
+ * \return код завершения процесса
+ */
+template <class Price, class Emit, class Calc>
+static int run_with(const cfg::main_config_t& config, par::thread_pool& pool, Calc calc) {
+    if (config.follow.enabled) {
+        return run_follow<Price, Emit>(config, pool, std::move(calc));
+    }
+    if (config.pipeline == cfg::pipeline_t::stream) {
+        return run_stream<Price, Emit>(config, pool, std::move(calc));
+    }
+    return run_batch<Price, Emit>(config, pool, std::move(calc));
+}
+
+/**
+ * \brief Сводка метрик в лог и, если задан main.metrics, в JSON.
+ *
+ * Ошибка записи JSON только предупреждает: код завершения не меняется.
+ */
+static void report_metrics(const cfg::main_config_t& config, double wall_seconds, int exit_code) {
+    const auto& m = metrics::global();
+    spdlog::info("Метрики (всего {:.3f} с):", wall_seconds);
+    for (const auto& line : m.report_lines()) spdlog::info("  {}", line);
+    spdlog::info("  пиковая память (RSS): {:.1f} МБ", metrics::peak_rss_bytes() / 1e6);
+    if (config.metrics.empty()) return;
+    if (auto err = m.write_json(config.metrics, wall_seconds, exit_code)) {
+        spdlog::warn("{}", *err);
+        return;
+    }
+    spdlog::info("Метрики записаны в {}", config.metrics.string());
+}
+
+/**
+ * \brief Запуск выбранного режима обработки с выбранным движком медианы.
+ *
+ * Тип цены, движок и политика записи подставляются в шаблоны один раз:
+ * в цикле по строкам нет виртуальных вызовов и проверок режима.
+ * \tparam Price тип цены: double или std::int64_t (фиксированная точка)
+ * \tparam Emit политика записи (emit::each_row / emit::each_timestamp)
+ * \return код завершения процесса
+ */
+template <class Price, class Emit>
+static int run_engine(const cfg::main_config_t& config, par::thread_pool& pool) {
+    if (config.median.engine == cfg::median_engine_t::exact) {
+        spdlog::info("Медиана: точная (две кучи)");
+        return run_with<Price, Emit>(config, pool, median::exact_median_calculator<Price>{});
+    }
+    if (config.median.engine == cfg::median_engine_t::window) {
+        spdlog::info("Медиана: скользящее окно, мкс: {}, тиков: {} (0 — без ограничения)",
+            config.median.window_us, config.median.window_ticks);
+        const median::window_spec spec{ config.median.window_us, config.median.window_ticks };
+        return run_with<Price, Emit>(config, pool, median::window_median_calculator<Price>(spec));
+    }
+    if (config.median.engine == cfg::median_engine_t::histogram) {
+        Price tick{};
+        if constexpr (std::is_integral_v<Price>) {
+            // шаг в единицах фиксированной точки должен быть целым
+            const double scaled = config.median.tick_size * static_cast<double>(csv::price_scale);
+            tick = static_cast<Price>(std::llround(scaled));
+            if (tick < 1 || std::abs(scaled - static_cast<double>(tick)) > 1e-6) {
+                spdlog::error("Ошибка конфига: 'median.tick_size' = {} не кратен 1e-8 (price_format = \"fixed\")",
+                    config.median.tick_size);
+                return 2;
+            }
+        }
+        else {
+            tick = config.median.tick_size;
+        }
+        spdlog::info("Медиана: точная по гистограмме, шаг цены {}", config.median.tick_size);
+        return run_with<Price, Emit>(config, pool, median::histogram_median_calculator<Price>(tick));
+    }
+    spdlog::info("Медиана: P^2 после {} значений", config.median.seed_threshold);
+    return run_with<Price, Emit>(config, pool, median::basic_median_calculator<Price>(config.median.seed_threshold));
+}
+
+/**
+ * \brief Запуск с замером времени и сводкой метрик в конце.
+ * \tparam Price тип цены: double или std::int64_t (фиксированная точка)
+ * \return код завершения процесса
+ */
+template <class Price>
+static int run(const cfg::main_config_t& config) {
+    const auto started = std::chrono::steady_clock::now();
+    spdlog::info("Сканер CSV: {}", csv::simd::isa_name(csv::simd::active_isa()));
+    par::thread_pool pool(config.threads);
+    spdlog::info("Потоков: {}", pool.size());
+    const int rc = config.emit == cfg::emit_mode_t::timestamp
+        ? run_engine<Price, emit::each_timestamp>(config, pool)
+        : run_engine<Price, emit::each_row>(config, pool);
+    report_metrics(config, seconds_of(std::chrono::steady_clock::now() - started), rc);
+    return rc;
+}
+
 int main(int argc, char** argv) 
 {
 #if defined(_WIN32)
@@ -81,6 +1089,7 @@ int main(int argc, char** argv)
         desc.add_options()
             ("help,h", "показать подсказку")
             ("config,cfg,config", po::value<std::string>(), "путь к config TOML (алиасы: -cfg, -config)")
+            ("follow,f", "после первого прохода следить за дописыванием входных файлов (до Ctrl+C)")
             ;
 
         po::variables_map vm;
@@ -143,82 +1152,29 @@ int main(int argc, char** argv)
             spdlog::error("Ошибка парсинга конфига: {}", *cfg_err);
             return 2;
         }
+        if (vm.count("follow")) {
+            config.follow.enabled = true;
+            if (auto mode_err = cfg::check_modes(config)) {
+                spdlog::error("Ошибка параметров: {}", *mode_err);
+                return 2;
+            }
+        }
 
         // Если output не задан — по умолчанию ./output (cwd)
         if (config.output_dir.empty()) {
             config.output_dir = fs::current_path() / "output";
         }
 
-        spdlog::info("Входная директория: {}", config.input_dir.string());
+        spdlog::info("Входные директории: {}{}", input_dirs_text(config), config.recursive ? " (с поддиректориями)" : "");
         spdlog::info("Директория вывода: {}", config.output_dir.string());
         spdlog::info("Фильтр по именам файлов: {}", config.filename_mask.empty() ? "<все>" : fmt::format("{}", fmt::join(config.filename_mask, ",")));
 
-        // ---- Чтение CSV файлов ----
-        std::vector<csv::record_t> records;
-        auto read_err = csv::read_csv_files(config.input_dir, config.filename_mask, records);
-        if (read_err) {
-            spdlog::error("Ошибка чтения CSV: {}", *read_err);
-            return 3;
-        }
-
-        spdlog::info("Прочитано записей: {}", records.size());
-        if (records.empty()) {
-            spdlog::warn("Нет записей для обработки. Завершение.");
-            return 0;
-        }
-
-        // ---- Стабильная сортировка по receive_ts (и tie-breaker по файлу/строке) ----
-        std::stable_sort(records.begin(), records.end(),
-            [](auto const& a, auto const& b) {
-                if (a.receive_ts != b.receive_ts) return a.receive_ts < b.receive_ts;
-                if (a.source_file != b.source_file) return a.source_file < b.source_file;
-                return a.line_no < b.line_no;
-            });
-
-        // ---- Подготовка выходного файла ----
-        try {
-            fs::create_directories(config.output_dir);
-        }
-        catch (const std::exception& ex) {
-            spdlog::error("Не удалось создать директорию вывода {}: {}", config.output_dir.string(), ex.what());
-            return 4;
-        }
+        spdlog::info("Формат цен: {}", config.price_format == cfg::price_format_t::fixed ? "fixed (int64)" : "double");
 
-        auto out_path = config.output_dir / "median_result.csv";
-        std::ofstream ofs(out_path, std::ios::out | std::ios::trunc);
-        if (!ofs.is_open()) {
-            spdlog::error("Не удалось открыть файл для записи: {}", out_path.string());
-            return 5;
+        if (config.price_format == cfg::price_format_t::fixed) {
+            return run<std::int64_t>(config);
         }
-        ofs << "receive_ts;price_median\n";
-
-        // ---- Инкрементальный расчёт медианы ----
-        median::median_calculator calc;
-        std::optional<std::string> last_median_str;
-
-        auto format_price = [](long double v) -> std::string {
-            std::ostringstream ss;
-            ss.setf(std::ios::fixed);
-            ss << std::setprecision(8) << (double)v;
-            return ss.str();
-            };
-
-        std::size_t changes_written = 0;
-        for (const auto& rec : records) {
-            calc.add(rec.price);
-            auto med_opt = calc.median();
-            if (!med_opt) continue;
-            auto med_str = format_price(*med_opt);
-            if (!last_median_str || (*last_median_str != med_str)) {
-                ofs << rec.receive_ts << ";" << med_str << "\n";
-                last_median_str = med_str;
-                ++changes_written;
-            }
-        }
-        ofs.close();
-        spdlog::info("Записано изменений медианы: {} в {}", changes_written, out_path.string());
-        spdlog::info("Готово.");
-        return 0;
+        return run<double>(config);
     }
     catch (const std::exception& ex) {
         spdlog::critical("Необработанное исключение: {}", ex.what());
@@ -0,0 +1,247 @@
+﻿#pragma once
+/**
+ * \file mapped_file.hpp
+ * \brief Отображение файла в память только для чтения (mmap / CreateFileMapping)
+ *
+ * Используется csv_reader.hpp: содержимое файла доступно как std::string_view
+ * без копирования, токены строк ссылаются прямо на отображённые байты.
+ * После отображения дескрипторы файла закрываются — открытыми одновременно
+ * могут быть тысячи отображений без упора в лимит дескрипторов.
+ *
+ * Чтение страниц отображения синхронно: на сетевом хранилище поток разбора
+ * ждёт каждую порцию read-ahead ядра. prefetch() заранее запрашивает у ОС
+ * большой диапазон (madvise(MADV_WILLNEED) / PrefetchVirtualMemory) и сразу
+ * возвращается — передача идёт параллельно с разбором уже прочитанного.
+ * read_ahead держит такие запросы на заданное окно впереди позиции разбора.
+ */
+
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <optional>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace csv {
+
+    class mapped_file {
+    public:
+        mapped_file() = default;
+        ~mapped_file() { close(); }
+
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+
+        mapped_file(mapped_file&& other) noexcept { swap(other); }
+        mapped_file& operator=(mapped_file&& other) noexcept {
+            if (this != &other) {
+                close();
+                swap(other);
+            }
+            return *this;
+        }
+
+        /**
+         * \brief Открывает файл и отображает его в память целиком.
+         * \param path путь к файлу
+         * \return std::nullopt при успехе, иначе строка с описанием ошибки
+         *
+         * Пустой файл открывается успешно, view() при этом возвращает пустую строку.
+         */
+        std::optional<std::string> open(const std::filesystem::path& path) {
+            close();
+#if defined(_WIN32)
+            _file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+                OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (_file == INVALID_HANDLE_VALUE) {
+                return std::string("Не удалось открыть CSV файл: ") + path.string();
+            }
+            LARGE_INTEGER size{};
+            if (!GetFileSizeEx(_file, &size)) {
+                close();
+                return std::string("Не удалось получить размер файла: ") + path.string();
+            }
+            _size = static_cast<std::size_t>(size.QuadPart);
+            if (_size == 0) return std::nullopt;
+
+            _mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (_mapping == nullptr) {
+                close();
+                return std::string("Не удалось отобразить файл в память: ") + path.string();
+            }
+            _data = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+            if (_data == nullptr) {
+                close();
+                return std::string("Не удалось отобразить файл в память: ") + path.string();
+            }
+            CloseHandle(_mapping);
+            CloseHandle(_file);
+            _mapping = nullptr;
+            _file = INVALID_HANDLE_VALUE;
+#else
+            _fd = ::open(path.c_str(), O_RDONLY);
+            if (_fd < 0) {
+                return std::string("Не удалось открыть CSV файл: ") + path.string();
+            }
+            struct stat st {};
+            if (::fstat(_fd, &st) != 0) {
+                close();
+                return std::string("Не удалось получить размер файла: ") + path.string();
+            }
+            _size = static_cast<std::size_t>(st.st_size);
+            if (_size == 0) return std::nullopt;
+
+            void* p = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+            if (p == MAP_FAILED) {
+                close();
+                return std::string("Не удалось отобразить файл в память: ") + path.string();
+            }
+            // файл читается один раз от начала до конца — подсказываем ядру read-ahead
+            ::madvise(p, _size, MADV_SEQUENTIAL);
+            _data = static_cast<const char*>(p);
+            ::close(_fd);
+            _fd = -1;
+#endif
+            return std::nullopt;
+        }
+
+        void close() noexcept {
+#if defined(_WIN32)
+            if (_data) UnmapViewOfFile(_data);
+            if (_mapping) CloseHandle(_mapping);
+            if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+            _mapping = nullptr;
+            _file = INVALID_HANDLE_VALUE;
+#else
+            if (_data) ::munmap(const_cast<char*>(_data), _size);
+            if (_fd >= 0) ::close(_fd);
+            _fd = -1;
+#endif
+            _data = nullptr;
+            _size = 0;
+            _discarded = 0;
+        }
+
+        std::string_view view() const noexcept {
+            return _data ? std::string_view(_data, _size) : std::string_view();
+        }
+
+        std::size_t size() const noexcept { return _size; }
+
+        /**
+         * \brief Асинхронно запрашивает у ОС байты [offset, offset + length), не дожидаясь чтения.
+         *
+         * На Windows до 8 (нет PrefetchVirtualMemory) вызов ничего не делает.
+         */
+        void prefetch(std::size_t offset, std::size_t length) const noexcept {
+            if (!_data || offset >= _size) return;
+            length = std::min(length, _size - offset);
+            if (length == 0) return;
+#if defined(_WIN32)
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+            WIN32_MEMORY_RANGE_ENTRY range{ const_cast<char*>(_data) + offset, length };
+            PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#endif
+#else
+            const auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+            const std::size_t begin = offset / page * page;
+            ::madvise(const_cast<char*>(_data) + begin, offset + length - begin, MADV_WILLNEED);
+#endif
+        }
+
+        /**
+         * \brief Подсказка ОС: байты до offset больше не понадобятся.
+         *
+         * Потоковое чтение освобождает уже разобранные страницы, чтобы резидентная
+         * память не росла с размером файла. На Windows страницы отображения
+         * вытесняются системой самостоятельно — вызов ничего не делает.
+         */
+        void discard_before(std::size_t offset) noexcept {
+#if !defined(_WIN32)
+            if (!_data) return;
+            const auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+            const std::size_t len = (std::min(offset, _size) / page) * page;
+            if (len > _discarded) {
+                ::madvise(const_cast<char*>(_data) + _discarded, len - _discarded, MADV_DONTNEED);
+                _discarded = len;
+            }
+#else
+            (void)offset;
+#endif
+        }
+
+    private:
+        void swap(mapped_file& other) noexcept {
+            std::swap(_data, other._data);
+            std::swap(_size, other._size);
+            std::swap(_discarded, other._discarded);
+#if defined(_WIN32)
+            std::swap(_file, other._file);
+            std::swap(_mapping, other._mapping);
+#else
+            std::swap(_fd, other._fd);
+#endif
+        }
+
+    private:
+        const char* _data = nullptr;
+        std::size_t _size = 0;
+        std::size_t _discarded = 0;  ///< байт от начала уже отданы ОС (discard_before)
+#if defined(_WIN32)
+        HANDLE _file = INVALID_HANDLE_VALUE;
+        HANDLE _mapping = nullptr;
+#else
+        int _fd = -1;
+#endif
+    };
+
+    /// Окно упреждающего чтения по умолчанию: 4 запроса по 4 МБ впереди позиции разбора
+    inline constexpr std::size_t default_read_ahead_bytes = std::size_t(16) << 20;
+
+    /**
+     * \brief Упреждающее чтение отображённого файла, который разбирается от начала к концу.
+     *
+     * advance(pos) дозапрашивает (mapped_file::prefetch) байты до pos + window
+     * порциями по window / 4, так что в полёте остаются несколько крупных чтений.
+     */
+    class read_ahead {
+    public:
+        /// \param window байт впереди позиции разбора; 0 — упреждающее чтение выключено
+        explicit read_ahead(std::size_t window = default_read_ahead_bytes)
+            : _window(window), _step(std::max<std::size_t>(window / 4, 1)) {}
+
+        /// Разбор дошёл до pos: запросить следующую порцию, если окно освободилось
+        void advance(const mapped_file& file, std::size_t pos) noexcept {
+            if (_window == 0) return;
+            const std::size_t target = std::min(file.size(), pos + _window);
+            _requested = std::max(_requested, pos);
+            if (target <= _requested || (target - _requested < _step && target != file.size())) return;
+            file.prefetch(_requested, target - _requested);
+            _requested = target;
+        }
+
+        std::size_t window() const noexcept { return _window; }
+
+    private:
+        std::size_t _window;
+        std::size_t _step;
+        std::size_t _requested = 0;  ///< байт от начала уже запрошены
+    };
+
+}  // namespace csv
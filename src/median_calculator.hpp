@@ -5,17 +5,32 @@
  *
  * Поведение:
  *  - Пока накоплено < seed_threshold элементов — хранит их в векторе и
- *    вычисляет точную медиану (nth_element).
+ *    вычисляет точную медиану. Параллельно значения кладутся в две кучи
+ *    (exact_median.hpp): add() — O(log n), median() — O(1) без копий и аллокаций.
  *  - Как только накоплено >= seed_threshold — создаётся Boost.Accumulators
  *    с p_square_quantile (quantile_probability = 0.5) и буфер переносится в аккумулятор.
  *
  * Примечание: правильный параметр для P^2 — boost::accumulators::quantile_probability.
+ *
+ * Тип значений — параметр шаблона: double или std::int64_t (цены в фиксированной
+ * точке). Для целых буфер и сравнения работают на целых; P^2 внутри
+ * считает в double, оценка округляется обратно до целого.
+ *
+ * add_batch / add_batch_and_emit принимают блок значений: после разгона
+ * режим проверяется один раз на блок, значения переводятся в double
+ * отдельным (векторизуемым) циклом и подаются в аккумулятор без ветвлений.
  */
 
 #include <vector>
+#include <span>
 #include <optional>
 #include <algorithm>
 #include <limits>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+#include "exact_median.hpp"
 
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics/stats.hpp>
@@ -29,16 +44,22 @@ namespace median {
     // Тип аккумулятора, оценивающего квантиль по алгоритму P^2
     using accumulator_t = accumulator_set<double, stats<tag::p_square_quantile>>;
 
-    class median_calculator {
+    template <class T>
+    class basic_median_calculator {
+        static_assert(std::is_arithmetic_v<T>, "median value type must be arithmetic");
+
     public:
-        explicit median_calculator(std::size_t seed_threshold = 64)
+        using value_type = T;
+
+        explicit basic_median_calculator(std::size_t seed_threshold = 64)
             : _seed_threshold(seed_threshold), _has_value(false), _using_psquare(false) {
+            reserve_buffers();
         }
 
-        void add(long double value) {
-            double v = static_cast<double>(value);
+        void add(T v) {
             if (!_using_psquare) {
                 _buffer.push_back(v);
+                _warmup.add(v);
                 _has_value = true;
                 if (_buffer.size() >= _seed_threshold) {
                     promote_to_psquare();
@@ -46,66 +67,143 @@ namespace median {
             }
             else {
                 // добавляем наблюдение в Boost-аккумулятор
-                (*_acc)(v);
+                (*_acc)(static_cast<double>(v));
                 _has_value = true;
             }
         }
 
-        std::optional<long double> median() const {
+        /// То же, что add() для каждого значения по порядку
+        void add_batch(std::span<const T> values) {
+            auto ignore = [](std::size_t, T) {};
+            std::size_t i = warm_up(values, ignore);
+            double buf[batch_block];
+            while (i < values.size()) {
+                const std::size_t n = to_double(values, i, buf);
+                for (std::size_t k = 0; k < n; ++k) (*_acc)(buf[k]);
+                i += n;
+            }
+        }
+
+        /**
+         * \brief add_batch, сообщающий медиану после каждого значения.
+         * \param on_median вызывается как on_median(i, медиана после values[i])
+         */
+        template <class OnMedian>
+        void add_batch_and_emit(std::span<const T> values, OnMedian&& on_median) {
+            std::size_t i = warm_up(values, on_median);
+            double buf[batch_block];
+            while (i < values.size()) {
+                const std::size_t n = to_double(values, i, buf);
+                for (std::size_t k = 0; k < n; ++k) {
+                    (*_acc)(buf[k]);
+                    on_median(i + k, from_estimate(boost::accumulators::p_square_quantile(*_acc)));
+                }
+                i += n;
+            }
+        }
+
+        std::optional<T> median() const {
             if (!_has_value) return std::nullopt;
             if (!_using_psquare) {
-                return static_cast<long double>(exact_median_from_buffer());
+                return _warmup.median();
             }
             else {
                 // корректный способ извлечения P^2-оценки
-                double m = boost::accumulators::p_square_quantile(*_acc);
-                return static_cast<long double>(m);
+                return from_estimate(boost::accumulators::p_square_quantile(*_acc));
             }
         }
 
         void reset() {
             _buffer.clear();
+            _warmup.reset();
+            reserve_buffers();
             _acc.reset();
             _using_psquare = false;
             _has_value = false;
         }
 
+        /**
+         * \brief Сохранение / восстановление состояния (архивы checkpoint.hpp).
+         *
+         * Маркеры P^2 сохраняются через serialize аккумулятора Boost.
+         */
+        template <class Archive>
+        void serialize_state(Archive& ar) {
+            ar & _seed_threshold & _has_value & _using_psquare & _buffer;
+            _warmup.serialize_state(ar);
+            bool has_acc = _acc.has_value();
+            ar & has_acc;
+            if (has_acc) {
+                if (!_acc) _acc.emplace(boost::accumulators::quantile_probability = 0.5);
+                _acc->serialize(ar, 0);
+            }
+        }
+
     private:
+        /// Значений на блок перевода в double в add_batch
+        static constexpr std::size_t batch_block = 256;
+
+        static T from_estimate(double m) {
+            if constexpr (std::is_integral_v<T>) {
+                return static_cast<T>(std::llround(m));
+            }
+            else {
+                return static_cast<T>(m);
+            }
+        }
+
+        /// Разгонные значения из начала values — по одному через add(); возвращает, сколько взято
+        template <class OnMedian>
+        std::size_t warm_up(std::span<const T> values, OnMedian& on_median) {
+            std::size_t i = 0;
+            for (; i < values.size() && !_using_psquare; ++i) {
+                add(values[i]);
+                on_median(i, *median());
+            }
+            return i;
+        }
+
+        /// Переводит до batch_block значений, начиная с first, в buf; возвращает их число
+        static std::size_t to_double(std::span<const T> values, std::size_t first, double* buf) {
+            const std::size_t n = std::min(batch_block, values.size() - first);
+            const T* src = values.data() + first;
+            for (std::size_t k = 0; k < n; ++k) buf[k] = static_cast<double>(src[k]);
+            return n;
+        }
+
+        /// Место под разгонный буфер выделяется один раз (не больше max_reserve элементов)
+        void reserve_buffers() {
+            constexpr std::size_t max_reserve = 1 << 16;
+            const std::size_t n = std::min(_seed_threshold, max_reserve);
+            _buffer.reserve(n);
+            _warmup.reserve(n);
+        }
+
         void promote_to_psquare() {
             // Создаём аккумулятор с параметром quantile_probability = 0.5 (медиана)
             // В boost::accumulators параметр называется quantile_probability и находится в пространстве имен boost::accumulators.
             _acc.emplace(boost::accumulators::quantile_probability = 0.5);
 
-            // "перекармливаем" буфер
-            for (double v : _buffer) {
-                (*_acc)(v);
+            // "перекармливаем" буфер в исходном порядке: от него зависит начальное состояние P^2
+            for (T v : _buffer) {
+                (*_acc)(static_cast<double>(v));
             }
             _buffer.clear();
+            _buffer.shrink_to_fit();
+            _warmup = {};
             _using_psquare = true;
         }
 
-        double exact_median_from_buffer() const {
-            if (_buffer.empty()) return std::numeric_limits<double>::quiet_NaN();
-            std::vector<double> tmp = _buffer;
-            const size_t n = tmp.size();
-            const size_t mid = n / 2;
-            std::nth_element(tmp.begin(), tmp.begin() + mid, tmp.end());
-            if (n % 2 == 1) {
-                return tmp[mid];
-            }
-            else {
-                double hi = tmp[mid];
-                double lo = *std::max_element(tmp.begin(), tmp.begin() + mid);
-                return (lo + hi) / 2.0;
-            }
-        }
-
     private:
         std::size_t _seed_threshold;
         bool _has_value;
         bool _using_psquare;
-        std::vector<double> _buffer;
+        std::vector<T> _buffer;              ///< разгонные значения в порядке поступления (для P^2)
+        exact_median_calculator<T> _warmup;  ///< те же значения в двух кучах
         std::optional<accumulator_t> _acc;
     };
 
+    using median_calculator = basic_median_calculator<double>;
+    using fixed_median_calculator = basic_median_calculator<std::int64_t>;
+
 } // namespace median
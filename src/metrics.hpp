@@ -0,0 +1,206 @@
+﻿#pragma once
+/**
+ * \file metrics.hpp
+ * \brief Время и пропускная способность стадий запуска, пиковая память
+ *
+ * Стадии (чтение, сортировка, расчёт медианы, запись...) накапливают время,
+ * число строк и байт; повторные вызовы с тем же именем суммируются, порядок —
+ * по первому появлению. Отдельно копятся счётчики (файлы, изменения медианы).
+ * В конце запуска main.cpp печатает сводку через spdlog и по желанию пишет
+ * JSON (main.metrics) для систем мониторинга.
+ *
+ * Собирает метрики один экземпляр на процесс (global()); запись защищена
+ * мьютексом, но рассчитана на вызовы из управляющего потока между стадиями.
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+#include <fmt/format.h>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace metrics {
+
+    struct stage_stats {
+        std::string name;
+        double seconds = 0;
+        std::uint64_t rows = 0;
+        std::uint64_t bytes = 0;
+    };
+
+    struct counter {
+        std::string name;
+        std::uint64_t value = 0;
+    };
+
+    /// Пиковый размер резидентной памяти процесса, байт (0 — недоступно)
+    inline std::uint64_t peak_rss_bytes() {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS pmc{};
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) return 0;
+        return static_cast<std::uint64_t>(pmc.PeakWorkingSetSize);
+#else
+        rusage ru{};
+        if (::getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#if defined(__APPLE__)
+        return static_cast<std::uint64_t>(ru.ru_maxrss);  // macOS: байты
+#else
+        return static_cast<std::uint64_t>(ru.ru_maxrss) * 1024;  // Linux, BSD: килобайты
+#endif
+#endif
+    }
+
+    class run_metrics {
+    public:
+        /// Добавляет время (и объём) к стадии name
+        void add(std::string_view name, double seconds, std::uint64_t rows = 0, std::uint64_t bytes = 0) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto& s = find(_stages, name);
+            s.seconds += seconds;
+            s.rows += rows;
+            s.bytes += bytes;
+        }
+
+        /// Прибавляет value к счётчику name
+        void count(std::string_view name, std::uint64_t value) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            find(_counters, name).value += value;
+        }
+
+        std::vector<stage_stats> stages() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _stages;
+        }
+
+        std::vector<counter> counters() const {
+            std::lock_guard<std::mutex> lock(_mutex);
+            return _counters;
+        }
+
+        /// Строки сводки для лога: по одной на стадию, затем счётчики
+        std::vector<std::string> report_lines() const {
+            std::vector<std::string> lines;
+            for (const auto& s : stages()) {
+                std::string line = fmt::format("{}: {:.3f} с", s.name, s.seconds);
+                if (s.rows) line += fmt::format(", строк {} ({:.2f} млн/с)", s.rows, rate(s.rows, s.seconds) / 1e6);
+                if (s.bytes) line += fmt::format(", {:.1f} МБ ({:.1f} МБ/с)", s.bytes / 1e6, rate(s.bytes, s.seconds) / 1e6);
+                lines.push_back(std::move(line));
+            }
+            for (const auto& c : counters()) lines.push_back(fmt::format("{}: {}", c.name, c.value));
+            return lines;
+        }
+
+        /// JSON со стадиями, счётчиками, общим временем, пиковой памятью и кодом завершения
+        std::string to_json(double wall_seconds, int exit_code) const {
+            std::string out = fmt::format("{{\n  \"exit_code\": {},\n  \"wall_seconds\": {:.6f},\n  \"peak_rss_bytes\": {},\n  \"stages\": [",
+                exit_code, wall_seconds, peak_rss_bytes());
+            const auto st = stages();
+            for (std::size_t i = 0; i < st.size(); ++i) {
+                const auto& s = st[i];
+                out += fmt::format("{}\n    {{\"name\": \"{}\", \"seconds\": {:.6f}, \"rows\": {}, \"bytes\": {}, "
+                    "\"rows_per_second\": {:.1f}, \"bytes_per_second\": {:.1f}}}",
+                    i ? "," : "", s.name, s.seconds, s.rows, s.bytes, rate(s.rows, s.seconds), rate(s.bytes, s.seconds));
+            }
+            out += "\n  ],\n  \"counters\": {";
+            const auto cs = counters();
+            for (std::size_t i = 0; i < cs.size(); ++i) {
+                out += fmt::format("{}\n    \"{}\": {}", i ? "," : "", cs[i].name, cs[i].value);
+            }
+            out += "\n  }\n}\n";
+            return out;
+        }
+
+        /**
+         * \brief Пишет to_json() в path.
+         * \return std::nullopt при успехе, иначе строка с описанием ошибки
+         */
+        std::optional<std::string> write_json(const std::filesystem::path& path, double wall_seconds, int exit_code) const {
+            std::ofstream ofs(path, std::ios::out | std::ios::trunc | std::ios::binary);
+            if (!ofs) return std::string("Не удалось открыть файл метрик: ") + path.string();
+            ofs << to_json(wall_seconds, exit_code);
+            if (!ofs.flush()) return std::string("Ошибка записи файла метрик: ") + path.string();
+            return std::nullopt;
+        }
+
+    private:
+        template <class T>
+        static T& find(std::vector<T>& items, std::string_view name) {
+            auto it = std::find_if(items.begin(), items.end(), [&](const T& v) { return v.name == name; });
+            if (it != items.end()) return *it;
+            items.push_back(T{ std::string(name) });
+            return items.back();
+        }
+
+        static double rate(std::uint64_t amount, double seconds) {
+            return seconds > 0 ? static_cast<double>(amount) / seconds : 0.0;
+        }
+
+    private:
+        mutable std::mutex _mutex;
+        std::vector<stage_stats> _stages;
+        std::vector<counter> _counters;
+    };
+
+    /// Метрики текущего запуска
+    inline run_metrics& global() {
+        static run_metrics m;
+        return m;
+    }
+
+    /**
+     * \brief Засекает стадию от конструктора до stop() или деструктора.
+     *
+     * Строки и байты можно указать по ходу (set_rows / set_bytes), когда
+     * объём становится известен только в конце стадии.
+     */
+    class stage_timer {
+    public:
+        explicit stage_timer(std::string_view name, run_metrics& m = global())
+            : _metrics(m), _name(name), _start(std::chrono::steady_clock::now()) {
+        }
+        ~stage_timer() { stop(); }
+
+        stage_timer(const stage_timer&) = delete;
+        stage_timer& operator=(const stage_timer&) = delete;
+
+        void set_rows(std::uint64_t rows) noexcept { _rows = rows; }
+        void set_bytes(std::uint64_t bytes) noexcept { _bytes = bytes; }
+
+        void stop() {
+            if (_stopped) return;
+            _stopped = true;
+            const std::chrono::duration<double> dt = std::chrono::steady_clock::now() - _start;
+            _metrics.add(_name, dt.count(), _rows, _bytes);
+        }
+
+    private:
+        run_metrics& _metrics;
+        std::string _name;
+        std::chrono::steady_clock::time_point _start;
+        std::uint64_t _rows = 0;
+        std::uint64_t _bytes = 0;
+        bool _stopped = false;
+    };
+
+}  // namespace metrics
@@ -0,0 +1,215 @@
+﻿#pragma once
+/**
+ * \file parse_cache.hpp
+ * \brief Двоичный колоночный кэш разобранных CSV файлов
+ *
+ * Рядом с входным файлом (или в main.cache_dir) кладётся <имя>.mcache
+ * (<имя>.fixed.mcache для цен int64): заголовок фиксированного размера и массивы
+ * receive_ts, price, [quantity], line_no подряд, выровненные на 8 байт. Кэш действителен, пока у исходного
+ * файла те же размер и время изменения; тип цены, имена колонок ([columns])
+ * и набор колонок тоже должны совпадать — иначе файл разбирается заново и кэш
+ * перезаписывается.
+ *
+ * Загрузка — отображение файла и memcpy массивов в хранилище, без разбора текста.
+ * Формат — в порядке байт машины, переносить кэш между архитектурами нельзя.
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <initializer_list>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <system_error>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#include "mapped_file.hpp"
+#include "record_store.hpp"
+
+namespace csv::cache {
+
+    inline constexpr std::string_view magic = "CSVMCACH";
+    inline constexpr std::uint32_t version = 3;
+    inline constexpr std::string_view extension = ".mcache";
+
+    /// Признак исходного файла, по которому проверяется актуальность кэша
+    struct source_stamp {
+        std::uint64_t size = 0;
+        std::int64_t mtime = 0;  ///< last_write_time в единицах file_clock
+    };
+
+    /// Сводка по файлу, которую иначе пришлось бы получить разбором
+    struct file_summary {
+        std::uint64_t lines = 0;     ///< строк данных (без заголовка), включая пустые
+        bool sorted = true;          ///< receive_ts не убывает
+        std::uint64_t first_ts = 0;
+        std::uint64_t last_ts = 0;
+    };
+
+    namespace detail {
+        inline constexpr std::uint32_t flag_fixed = 1;     ///< цены int64 (иначе double)
+        inline constexpr std::uint32_t flag_quantity = 2;  ///< есть колонка quantity
+        inline constexpr std::uint32_t flag_sorted = 4;
+
+        struct header_t {
+            char magic[8];
+            std::uint32_t version;
+            std::uint32_t flags;
+            std::uint64_t source_size;
+            std::int64_t source_mtime;
+            std::uint64_t rows;
+            std::uint64_t lines;
+            std::uint64_t first_ts;
+            std::uint64_t last_ts;
+            std::uint64_t columns;  ///< columns_key() имён колонок, из которых разобран файл
+        };
+        static_assert(sizeof(header_t) == 72);
+
+        template <class Price>
+        constexpr std::uint32_t price_flag() { return std::is_integral_v<Price> ? flag_fixed : 0u; }
+
+        template <class T>
+        void write_array(std::ofstream& ofs, const T* data, std::size_t n) {
+            ofs.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(n * sizeof(T)));
+        }
+
+        template <class T>
+        void read_array(const char*& p, std::vector<T>& column, std::size_t n) {
+            column.resize(n);
+            if (n != 0) std::memcpy(column.data(), p, n * sizeof(T));
+            p += n * sizeof(T);
+        }
+    }  // namespace detail
+
+    /// Ключ имён колонок (FNV-1a): кэш, разобранный по другим колонкам, не подходит
+    inline std::uint64_t columns_key(std::string_view ts, std::string_view price, std::string_view quantity) {
+        std::uint64_t h = 14695981039346656037ull;
+        for (const auto name : { ts, price, quantity }) {
+            for (const char c : name) {
+                h ^= static_cast<unsigned char>(c);
+                h *= 1099511628211ull;
+            }
+            h ^= 0xff;  // разделитель: ("ab", "c") и ("a", "bc") различаются
+            h *= 1099511628211ull;
+        }
+        return h;
+    }
+
+    /// Размер и время изменения файла; std::nullopt, если файл недоступен
+    inline std::optional<source_stamp> stamp_of(const std::filesystem::path& path) {
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(path, ec);
+        if (ec) return std::nullopt;
+        const auto mtime = std::filesystem::last_write_time(path, ec);
+        if (ec) return std::nullopt;
+        return source_stamp{ static_cast<std::uint64_t>(size),
+            static_cast<std::int64_t>(mtime.time_since_epoch().count()) };
+    }
+
+    /**
+     * \brief Путь кэша для source: рядом с ним или в dir, если задана.
+     *
+     * Для цен int64 имя получает суффикс .fixed: запуски с разным price_format
+     * не перезаписывают кэш друг друга.
+     */
+    template <class Price>
+    std::filesystem::path sidecar_path(const std::filesystem::path& source, const std::filesystem::path& dir) {
+        auto name = source.filename();
+        if constexpr (std::is_integral_v<Price>) name += ".fixed";
+        name += extension;
+        return dir.empty() ? source.parent_path() / name : dir / name;
+    }
+
+    /**
+     * \brief Загружает строки из кэша, если он соответствует stamp и запрошенным колонкам.
+     * \param columns columns_key() текущих имён колонок
+     * \param rows хранилище (ожидается пустым); line_no — абсолютные номера строк файла
+     * \return true при попадании
+     */
+    template <class Price>
+    bool load(const std::filesystem::path& cache_path, const source_stamp& stamp, std::uint64_t columns, bool need_quantity,
+        file_id_t file_id, basic_record_store<Price>& rows, file_summary& summary) {
+        mapped_file file;
+        if (file.open(cache_path)) return false;
+        const auto data = file.view();
+        if (data.size() < sizeof(detail::header_t)) return false;
+        detail::header_t h;
+        std::memcpy(&h, data.data(), sizeof(h));
+        if (std::string_view(h.magic, sizeof(h.magic)) != magic || h.version != version) return false;
+        if (h.source_size != stamp.size || h.source_mtime != stamp.mtime) return false;
+        if (h.columns != columns) return false;
+        if ((h.flags & detail::flag_fixed) != detail::price_flag<Price>()) return false;
+        const bool has_quantity = (h.flags & detail::flag_quantity) != 0;
+        if (need_quantity && !has_quantity) return false;
+        const std::uint64_t row_bytes = 8 + sizeof(Price) + (has_quantity ? 8 : 0) + sizeof(line_no_t);
+        if (h.rows > (data.size() - sizeof(h)) / row_bytes || h.rows * row_bytes != data.size() - sizeof(h)) {
+            return false;
+        }
+
+        const auto n = static_cast<std::size_t>(h.rows);
+        const char* p = data.data() + sizeof(h);
+        detail::read_array(p, rows.receive_ts, n);
+        detail::read_array(p, rows.price, n);
+        if (has_quantity) {
+            if (need_quantity) detail::read_array(p, rows.quantity, n);
+            else p += n * sizeof(double);
+        }
+        detail::read_array(p, rows.line_no, n);
+        rows.file_id.assign(n, file_id);
+        summary = { h.lines, (h.flags & detail::flag_sorted) != 0, h.first_ts, h.last_ts };
+        return true;
+    }
+
+    /**
+     * \brief Пишет строки [begin, end) хранилища rows (один файл целиком) в кэш.
+     * \return std::nullopt при успехе, иначе строка с описанием ошибки
+     *
+     * Запись идёт во временный файл с последующим переименованием: прерванный
+     * запуск не оставляет наполовину записанный кэш.
+     */
+    template <class Price>
+    std::optional<std::string> save(const std::filesystem::path& cache_path, const source_stamp& stamp,
+        std::uint64_t columns, const basic_record_store<Price>& rows, std::size_t begin, std::size_t end, const file_summary& summary) {
+        const bool has_quantity = !rows.quantity.empty();
+        detail::header_t h{};
+        std::memcpy(h.magic, magic.data(), sizeof(h.magic));
+        h.version = version;
+        h.flags = detail::price_flag<Price>() | (has_quantity ? detail::flag_quantity : 0u)
+            | (summary.sorted ? detail::flag_sorted : 0u);
+        h.source_size = stamp.size;
+        h.source_mtime = stamp.mtime;
+        h.rows = end - begin;
+        h.lines = summary.lines;
+        h.first_ts = summary.first_ts;
+        h.last_ts = summary.last_ts;
+        h.columns = columns;
+
+        auto tmp = cache_path;
+        tmp += ".tmp";
+        {
+            std::ofstream ofs(tmp, std::ios::out | std::ios::trunc | std::ios::binary);
+            if (!ofs) return std::string("Не удалось записать кэш: ") + tmp.string();
+            ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+            const std::size_t n = end - begin;
+            detail::write_array(ofs, rows.receive_ts.data() + begin, n);
+            detail::write_array(ofs, rows.price.data() + begin, n);
+            if (has_quantity) detail::write_array(ofs, rows.quantity.data() + begin, n);
+            detail::write_array(ofs, rows.line_no.data() + begin, n);
+            if (!ofs.flush()) {
+                ofs.close();
+                std::error_code ec;
+                std::filesystem::remove(tmp, ec);
+                return std::string("Не удалось записать кэш: ") + tmp.string();
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, cache_path, ec);
+        if (ec) return std::string("Не удалось записать кэш: ") + cache_path.string() + ": " + ec.message();
+        return std::nullopt;
+    }
+
+}  // namespace csv::cache
@@ -0,0 +1,161 @@
+﻿#pragma once
+/**
+ * \file quantile_stats.hpp
+ * \brief Дополнительные колонки результата: квантили, min/max/mean и VWAP за один проход.
+ *
+ * Квантили оцениваются одним аккумулятором Boost extended_p_square сразу для всех
+ * запрошенных вероятностей (постоянная память). Первые warmup значений считаются
+ * точно по отсортированному буферу (интерполяция как у numpy / R type 7), затем
+ * буфер в исходном порядке передаётся аккумулятору — как в median_calculator.hpp.
+ * min, max, mean и VWAP (sum(price * quantity) / sum(quantity)) точные.
+ *
+ * Статистики накопительные — с начала данных, независимо от движка медианы.
+ */
+
+#include <vector>
+#include <string>
+#include <optional>
+#include <algorithm>
+#include <charconv>
+#include <limits>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+
+#include <boost/accumulators/accumulators.hpp>
+#include <boost/accumulators/statistics/stats.hpp>
+#include <boost/accumulators/statistics/extended_p_square.hpp>
+
+namespace median {
+
+    /// Какие статистики считать; порядок колонок — как в column_names()
+    struct stats_spec {
+        std::vector<double> quantiles;  ///< вероятности из (0, 1)
+        bool min = false;
+        bool max = false;
+        bool mean = false;
+        bool vwap = false;
+
+        bool empty() const noexcept { return quantiles.empty() && !min && !max && !mean && !vwap; }
+
+        /// Имена колонок: p25, p99.9, min, max, mean, vwap
+        std::vector<std::string> column_names() const {
+            std::vector<std::string> names;
+            for (double q : quantiles) {
+                char buf[32];
+                // 10 значащих цифр убирают шум умножения: 0.29 * 100 — p29, а не p28.999999999999996
+                const auto end = std::to_chars(buf, buf + sizeof(buf), q * 100.0, std::chars_format::general, 10).ptr;
+                names.push_back("p" + std::string(buf, end));
+            }
+            if (min) names.emplace_back("min");
+            if (max) names.emplace_back("max");
+            if (mean) names.emplace_back("mean");
+            if (vwap) names.emplace_back("vwap");
+            return names;
+        }
+    };
+
+    template <class T>
+    class stats_calculator {
+        static_assert(std::is_arithmetic_v<T>, "stats value type must be arithmetic");
+
+        using quantile_acc_t = boost::accumulators::accumulator_set<double,
+            boost::accumulators::stats<boost::accumulators::tag::extended_p_square>>;
+
+    public:
+        using value_type = T;
+
+        /// Сколько первых значений считаются точно
+        static constexpr std::size_t warmup = 64;
+
+        explicit stats_calculator(stats_spec spec) : _spec(std::move(spec)) {
+            _buffer.reserve(warmup);
+            _sorted.reserve(warmup);
+        }
+
+        void add(T price, double quantity) {
+            const double v = static_cast<double>(price);
+            if (_count == 0) {
+                _min = _max = v;
+            }
+            else {
+                _min = std::min(_min, v);
+                _max = std::max(_max, v);
+            }
+            ++_count;
+            _sum += v;
+            _pq_sum += v * quantity;
+            _q_sum += quantity;
+
+            if (_spec.quantiles.empty()) return;
+            if (_acc) {
+                (*_acc)(v);
+                return;
+            }
+            _buffer.push_back(v);
+            _sorted.insert(std::upper_bound(_sorted.begin(), _sorted.end(), v), v);
+            if (_buffer.size() >= warmup) {
+                _acc.emplace(boost::accumulators::tag::extended_p_square::probabilities = _spec.quantiles);
+                for (double b : _buffer) (*_acc)(b);
+                _buffer.clear();
+                _sorted.clear();
+            }
+        }
+
+        /**
+         * \brief Значения в порядке stats_spec::column_names().
+         *
+         * NaN — значения нет (нет данных или нулевой суммарный объём для VWAP).
+         */
+        void values(std::vector<double>& out) const {
+            constexpr double none = std::numeric_limits<double>::quiet_NaN();
+            out.clear();
+            for (std::size_t i = 0; i < _spec.quantiles.size(); ++i) {
+                if (_acc) {
+                    out.push_back(boost::accumulators::extended_p_square(*_acc)[i]);
+                }
+                else {
+                    out.push_back(_sorted.empty() ? none : exact_quantile(_spec.quantiles[i]));
+                }
+            }
+            if (_spec.min) out.push_back(_count ? _min : none);
+            if (_spec.max) out.push_back(_count ? _max : none);
+            if (_spec.mean) out.push_back(_count ? _sum / static_cast<double>(_count) : none);
+            if (_spec.vwap) out.push_back(_q_sum != 0.0 ? _pq_sum / _q_sum : none);
+        }
+
+        /// Сохранение / восстановление состояния (архивы checkpoint.hpp)
+        template <class Archive>
+        void serialize_state(Archive& ar) {
+            ar & _count & _min & _max & _sum & _pq_sum & _q_sum & _buffer & _sorted;
+            bool has_acc = _acc.has_value();
+            ar & has_acc;
+            if (has_acc) {
+                if (!_acc) _acc.emplace(boost::accumulators::tag::extended_p_square::probabilities = _spec.quantiles);
+                _acc->serialize(ar, 0);
+            }
+        }
+
+    private:
+        /// Квантиль по отсортированному буферу с линейной интерполяцией (type 7)
+        double exact_quantile(double p) const {
+            const double h = static_cast<double>(_sorted.size() - 1) * p;
+            const auto lo = static_cast<std::size_t>(h);
+            if (lo + 1 >= _sorted.size()) return _sorted.back();
+            return _sorted[lo] + (h - static_cast<double>(lo)) * (_sorted[lo + 1] - _sorted[lo]);
+        }
+
+    private:
+        stats_spec _spec;
+        std::size_t _count = 0;
+        double _min = 0.0;
+        double _max = 0.0;
+        double _sum = 0.0;
+        double _pq_sum = 0.0;
+        double _q_sum = 0.0;
+        std::vector<double> _buffer;   ///< разгонные значения в порядке поступления
+        std::vector<double> _sorted;   ///< те же значения по возрастанию
+        std::optional<quantile_acc_t> _acc;
+    };
+
+}  // namespace median
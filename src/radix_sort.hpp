@@ -0,0 +1,104 @@
+﻿#pragma once
+/**
+ * \file radix_sort.hpp
+ * \brief Параллельная стабильная LSD-сортировка 64-битных ключей
+ *
+ * Ключи сортируются по байту за проход и только по битам [first_bit, last_bit):
+ * младшие биты могут хранить полезную нагрузку (например, номер строки),
+ * старшие нулевые байты не просматриваются. Проход, в котором у всех ключей
+ * одинаковый байт, пропускается — это видно по гистограмме.
+ *
+ * Каждый проход: потоки считают гистограммы своих блоков, затем по
+ * префиксным суммам (байт, блок) раскладывают элементы на свои места.
+ * Блоки идут по порядку и внутри блока порядок сохраняется — сортировка
+ * стабильна и результат не зависит от числа потоков.
+ */
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+#include "thread_pool.hpp"
+
+namespace par {
+
+    /// Строк на блок не меньше: на меньших блоках гистограммы дороже самой раскладки
+    inline constexpr std::size_t radix_min_block = std::size_t(1) << 16;
+
+    namespace detail {
+        /// Общая часть: values == nullptr — сортируются только ключи
+        template <class Value>
+        void radix_passes(std::vector<std::uint64_t>& keys, std::vector<Value>* values,
+            unsigned first_bit, unsigned last_bit, thread_pool& pool) {
+            const std::size_t n = keys.size();
+            if (n < 2 || first_bit >= last_bit) return;
+            const std::size_t blocks = std::clamp<std::size_t>(n / radix_min_block, 1, pool.size());
+            const auto block_begin = [&](std::size_t b) { return n * b / blocks; };
+
+            std::vector<std::uint64_t> keys_tmp(n);
+            std::vector<Value> values_tmp(values ? n : 0);
+            std::vector<std::array<std::size_t, 256>> hist(blocks);
+            for (unsigned shift = first_bit; shift < last_bit; shift += 8) {
+                pool.parallel_for(blocks, [&](std::size_t b) {
+                    // локальные копии: запись ключей не должна заставлять перечитывать гистограмму
+                    std::array<std::size_t, 256> h{};
+                    const std::uint64_t* k = keys.data();
+                    for (std::size_t i = block_begin(b), e = block_begin(b + 1); i < e; ++i) ++h[(k[i] >> shift) & 0xff];
+                    hist[b] = h;
+                });
+                // все ключи с одним байтом — проход ничего не меняет
+                bool uniform = false;
+                for (std::size_t d = 0; d < 256 && !uniform; ++d) {
+                    std::size_t count = 0;
+                    for (const auto& h : hist) count += h[d];
+                    uniform = count == n;
+                }
+                if (uniform) continue;
+                std::size_t sum = 0;
+                for (std::size_t d = 0; d < 256; ++d) {
+                    for (auto& h : hist) {
+                        const std::size_t count = h[d];
+                        h[d] = sum;
+                        sum += count;
+                    }
+                }
+                pool.parallel_for(blocks, [&](std::size_t b) {
+                    std::array<std::size_t, 256> at = hist[b];
+                    const std::uint64_t* k = keys.data();
+                    std::uint64_t* k_out = keys_tmp.data();
+                    const std::size_t begin = block_begin(b), end = block_begin(b + 1);
+                    if (values) {
+                        const Value* v = values->data();
+                        Value* v_out = values_tmp.data();
+                        for (std::size_t i = begin; i < end; ++i) {
+                            const std::size_t pos = at[(k[i] >> shift) & 0xff]++;
+                            k_out[pos] = k[i];
+                            v_out[pos] = v[i];
+                        }
+                    }
+                    else {
+                        for (std::size_t i = begin; i < end; ++i) k_out[at[(k[i] >> shift) & 0xff]++] = k[i];
+                    }
+                });
+                keys.swap(keys_tmp);
+                if (values) values->swap(values_tmp);
+            }
+        }
+    }  // namespace detail
+
+    /// Стабильно сортирует keys по битам [first_bit, last_bit)
+    inline void radix_sort_keys(std::vector<std::uint64_t>& keys, unsigned first_bit, unsigned last_bit,
+        thread_pool& pool) {
+        detail::radix_passes<std::uint64_t>(keys, nullptr, first_bit, last_bit, pool);
+    }
+
+    /// Стабильно сортирует values по keys (младшие key_bits бит), оба массива переставляются согласованно
+    template <class Value>
+    void radix_sort_pairs(std::vector<std::uint64_t>& keys, std::vector<Value>& values,
+        unsigned key_bits, thread_pool& pool) {
+        detail::radix_passes(keys, &values, 0, key_bits, pool);
+    }
+
+}  // namespace par
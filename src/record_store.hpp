@@ -0,0 +1,383 @@
+﻿#pragma once
+/**
+ * \file record_store.hpp
+ * \brief Колоночное хранилище записей CSV (struct-of-arrays)
+ *
+ * Вместо вектора структур с путём к файлу в каждой строке хранятся отдельные
+ * массивы: receive_ts, цена, номер файла в таблице files и номер строки.
+ * На строку приходится 8 + sizeof(Price) + 2 + 4 байта (22 для double/int64).
+ *
+ * После чтения строки каждого файла лежат подряд (runs). Если файлы уже
+ * упорядочены по receive_ts, merge_by_time сливает их кучей за O(N log K)
+ * вместо полной сортировки; неупорядоченные файлы сортируются по отдельности.
+ * Полная сортировка — параллельная LSD-сортировка (radix_sort.hpp) по ключу
+ * receive_ts - min, с предварительным проходом по (file_id, line_no), только
+ * если строки идут не в этом порядке.
+ *
+ * Для группировки (group_by.hpp) у строки может быть ключ группы: колонка group_id
+ * заполняется только в этом режиме, имена ключей интернируются в таблице groups.
+ * Колонка quantity (объём) тоже необязательна — она нужна только для VWAP.
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+#include <optional>
+#include <numeric>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+#include <functional>
+#include <bit>
+
+#include "radix_sort.hpp"
+#include "thread_pool.hpp"
+
+namespace csv {
+
+    using file_id_t = std::uint16_t;
+    using line_no_t = std::uint32_t;
+    /// Индекс строки в хранилище (перестановки при сортировке)
+    using row_index_t = std::uint32_t;
+
+    /// Номер ключа группы в group_table
+    using group_id_t = std::uint32_t;
+
+    /// Интернированные ключи групп: имя -> group_id в порядке первого появления
+    struct group_table {
+        struct name_hash {
+            using is_transparent = void;
+            std::size_t operator()(std::string_view s) const noexcept { return std::hash<std::string_view>{}(s); }
+        };
+
+        std::vector<std::string> names;
+        std::unordered_map<std::string, group_id_t, name_hash, std::equal_to<>> index;
+
+        std::size_t size() const noexcept { return names.size(); }
+
+        group_id_t intern(std::string_view name) {
+            if (auto it = index.find(name); it != index.end()) return it->second;
+            const auto id = static_cast<group_id_t>(names.size());
+            names.emplace_back(name);
+            index.emplace(names.back(), id);
+            return id;
+        }
+
+        void clear() {
+            names.clear();
+            index.clear();
+        }
+    };
+
+    /// Диапазон строк одного файла в хранилище
+    struct run_t {
+        std::size_t begin = 0;
+        std::size_t end = 0;
+        bool sorted = true;  ///< receive_ts не убывает внутри файла
+    };
+
+    template <class Price>
+    struct basic_record_store {
+        using price_type = Price;
+
+        /// Таблица файлов: индекс — file_id
+        std::vector<std::filesystem::path> files;
+        /// Строки файлов (индекс — file_id); сбрасывается после переупорядочивания
+        std::vector<run_t> runs;
+
+        std::vector<std::uint64_t> receive_ts;
+        std::vector<Price> price;
+        std::vector<file_id_t> file_id;
+        std::vector<line_no_t> line_no;
+        /// Ключ группы строки; пусто, если группировка не используется
+        std::vector<group_id_t> group_id;
+        group_table groups;
+        /// Объём (колонка quantity); пусто, если не читается
+        std::vector<double> quantity;
+
+        std::size_t size() const noexcept { return receive_ts.size(); }
+        bool empty() const noexcept { return receive_ts.empty(); }
+
+        void clear() {
+            files.clear();
+            runs.clear();
+            receive_ts.clear();
+            price.clear();
+            file_id.clear();
+            line_no.clear();
+            group_id.clear();
+            groups.clear();
+            quantity.clear();
+        }
+
+        void reserve(std::size_t rows) {
+            receive_ts.reserve(rows);
+            price.reserve(rows);
+            file_id.reserve(rows);
+            line_no.reserve(rows);
+        }
+
+        /**
+         * \brief Регистрирует файл в таблице.
+         * \return std::nullopt если таблица переполнена, иначе file_id
+         */
+        std::optional<file_id_t> add_file(const std::filesystem::path& path) {
+            if (files.size() > std::numeric_limits<file_id_t>::max()) return std::nullopt;
+            files.push_back(path);
+            return static_cast<file_id_t>(files.size() - 1);
+        }
+
+        void push_back(std::uint64_t ts, Price p, file_id_t fid, line_no_t line) {
+            receive_ts.push_back(ts);
+            price.push_back(p);
+            file_id.push_back(fid);
+            line_no.push_back(line);
+        }
+
+        /// Дописывает строку i из src со всеми заполненными необязательными колонками
+        void copy_row_from(const basic_record_store& src, std::size_t i) {
+            push_back(src.receive_ts[i], src.price[i], src.file_id[i], src.line_no[i]);
+            if (!src.group_id.empty()) group_id.push_back(src.group_id[i]);
+            if (!src.quantity.empty()) quantity.push_back(src.quantity[i]);
+        }
+
+        /// Оставляет первые n строк
+        void truncate(std::size_t n) {
+            receive_ts.resize(n);
+            price.resize(n);
+            file_id.resize(n);
+            line_no.resize(n);
+            if (!group_id.empty()) group_id.resize(n);
+            if (!quantity.empty()) quantity.resize(n);
+        }
+
+        /// Поменять местами строки согласно перестановке: новая строка i = старая order[i]
+        void apply_order(const std::vector<row_index_t>& order, par::thread_pool& pool) {
+            gather(receive_ts, order, pool);
+            gather(price, order, pool);
+            gather(file_id, order, pool);
+            gather(line_no, order, pool);
+            if (!group_id.empty()) gather(group_id, order, pool);
+            if (!quantity.empty()) gather(quantity, order, pool);
+            runs.clear();
+        }
+
+        void apply_order(const std::vector<row_index_t>& order) {
+            par::thread_pool serial(1);
+            apply_order(order, serial);
+        }
+
+        /**
+         * \brief Индексы строк [first, last) в порядке (receive_ts, file_id, line_no).
+         *
+         * Мелкие диапазоны сортируются сравнением, крупные — LSD-сортировкой на pool.
+         */
+        std::vector<row_index_t> time_order(std::size_t first, std::size_t last, par::thread_pool& pool) const {
+            const std::size_t n = last - first;
+            std::vector<row_index_t> order(n);
+            std::iota(order.begin(), order.end(), static_cast<row_index_t>(first));
+            const auto before = [this](row_index_t a, row_index_t b) {
+                if (receive_ts[a] != receive_ts[b]) return receive_ts[a] < receive_ts[b];
+                if (file_id[a] != file_id[b]) return file_id[a] < file_id[b];
+                return line_no[a] < line_no[b];
+            };
+            if (n < small_sort_rows) {
+                std::sort(order.begin(), order.end(), before);
+                return order;
+            }
+
+            // диапазон receive_ts и порядок (file_id, line_no) — по блокам на pool
+            const std::size_t blocks = std::clamp<std::size_t>(n / par::radix_min_block, 1, pool.size());
+            struct block_info {
+                std::uint64_t min_ts = std::numeric_limits<std::uint64_t>::max();
+                std::uint64_t max_ts = 0;
+                bool tie_sorted = true;  ///< (file_id, line_no) не убывает внутри блока и на стыке с предыдущим
+            };
+            std::vector<block_info> info(blocks);
+            const auto tie_of = [this](std::size_t i) {
+                return (std::uint64_t(file_id[i]) << 32) | line_no[i];
+            };
+            pool.parallel_for(blocks, [&](std::size_t b) {
+                auto& bi = info[b];
+                const std::size_t begin = first + n * b / blocks, end = first + n * (b + 1) / blocks;
+                for (std::size_t i = begin; i < end; ++i) {
+                    bi.min_ts = std::min(bi.min_ts, receive_ts[i]);
+                    bi.max_ts = std::max(bi.max_ts, receive_ts[i]);
+                    if (i > first && tie_of(i) < tie_of(i - 1)) bi.tie_sorted = false;
+                }
+            });
+            std::uint64_t min_ts = std::numeric_limits<std::uint64_t>::max(), max_ts = 0;
+            bool tie_sorted = true;
+            for (const auto& bi : info) {
+                min_ts = std::min(min_ts, bi.min_ts);
+                max_ts = std::max(max_ts, bi.max_ts);
+                tie_sorted = tie_sorted && bi.tie_sorted;
+            }
+
+            // стабильная сортировка: сначала младший ключ (file_id, line_no), если исходный порядок не тот
+            std::vector<std::uint64_t> keys(n);
+            if (!tie_sorted) {
+                std::uint64_t max_tie = 0;
+                for (std::size_t i = 0; i < n; ++i) max_tie = std::max(max_tie, keys[i] = tie_of(first + i));
+                par::radix_sort_pairs(keys, order, static_cast<unsigned>(std::bit_width(max_tie)), pool);
+            }
+            const unsigned ts_bits = static_cast<unsigned>(std::bit_width(max_ts - min_ts));
+            const unsigned pos_bits = static_cast<unsigned>(std::bit_width(n - 1));
+            if (ts_bits + pos_bits > 64) {
+                pool.parallel_for(blocks, [&](std::size_t b) {
+                    for (std::size_t i = n * b / blocks, e = n * (b + 1) / blocks; i < e; ++i) {
+                        keys[i] = receive_ts[order[i]] - min_ts;
+                    }
+                });
+                par::radix_sort_pairs(keys, order, ts_bits, pool);
+                return order;
+            }
+
+            // ключ и позиция в одном слове: каждый проход переносит 8 байт на строку вместо 12
+            pool.parallel_for(blocks, [&](std::size_t b) {
+                for (std::size_t i = n * b / blocks, e = n * (b + 1) / blocks; i < e; ++i) {
+                    keys[i] = ((receive_ts[order[i]] - min_ts) << pos_bits) | i;
+                }
+            });
+            par::radix_sort_keys(keys, pos_bits, pos_bits + ts_bits, pool);
+            std::vector<row_index_t> sorted(n);
+            const std::uint64_t pos_mask = (std::uint64_t(1) << pos_bits) - 1;
+            pool.parallel_for(blocks, [&](std::size_t b) {
+                for (std::size_t i = n * b / blocks, e = n * (b + 1) / blocks; i < e; ++i) {
+                    sorted[i] = order[keys[i] & pos_mask];
+                }
+            });
+            return sorted;
+        }
+
+        /**
+         * \brief Сортировка по receive_ts; при равенстве — по файлу, затем по строке.
+         *
+         * file_id назначаются в порядке сортировки путей, поэтому порядок
+         * совпадает со сравнением путей как строк. Результат не зависит от числа потоков pool.
+         */
+        void sort_by_time(par::thread_pool& pool) {
+            apply_order(time_order(0, size(), pool), pool);
+        }
+
+        void sort_by_time() {
+            par::thread_pool serial(1);
+            sort_by_time(serial);
+        }
+
+        /// Сколько файлов не упорядочены по receive_ts
+        std::size_t unsorted_runs() const {
+            return static_cast<std::size_t>(std::count_if(runs.begin(), runs.end(),
+                [](const run_t& r) { return !r.sorted && r.end > r.begin; }));
+        }
+
+        /**
+         * \brief Тот же порядок, что у sort_by_time, через k-way слияние файлов.
+         *
+         * Упорядоченные файлы сливаются как есть (tie-break по file_id; внутри файла
+         * строки уже идут по line_no), неупорядоченные предварительно сортируются
+         * по отдельности — параллельно на pool. Без сведений о runs — полная сортировка.
+         */
+        void merge_by_time(par::thread_pool& pool) {
+            std::size_t covered = 0, nonempty = 0;
+            for (const auto& r : runs) {
+                covered += r.end - r.begin;
+                if (r.end > r.begin) ++nonempty;
+            }
+            if (covered != size()) {
+                sort_by_time(pool);
+                return;
+            }
+            if (nonempty <= 1 && unsorted_runs() == 0) {
+                runs.clear();
+                return;  // один упорядоченный файл — уже на месте
+            }
+
+            // неупорядоченные строки — большая часть: параллельная сортировка всего хранилища
+            // быстрее, чем сортировка файлов по одному на поток и последовательное слияние
+            std::size_t unsorted_rows = 0;
+            for (const auto& r : runs) {
+                if (!r.sorted) unsorted_rows += r.end - r.begin;
+            }
+            if (pool.size() > 1 && unsorted_rows * 2 > size()) {
+                sort_by_time(pool);
+                return;
+            }
+
+            // индексы строк каждого неупорядоченного файла в порядке (receive_ts, line_no)
+            std::vector<std::vector<row_index_t>> sorted_rows(runs.size());
+            pool.parallel_for(runs.size(), [&](std::size_t f) {
+                const auto& r = runs[f];
+                if (r.sorted) return;
+                par::thread_pool serial(1);
+                sorted_rows[f] = time_order(r.begin, r.end, serial);
+            });
+
+            struct head_t {
+                std::uint64_t ts;
+                std::size_t file;
+                std::size_t pos;  ///< позиция внутри файла
+            };
+            // std::*_heap строят max-кучу: «больший» элемент — с большим (ts, file)
+            const auto later = [](const head_t& a, const head_t& b) {
+                if (a.ts != b.ts) return a.ts > b.ts;
+                return a.file > b.file;
+            };
+            const auto row_at = [&](std::size_t f, std::size_t pos) -> row_index_t {
+                return runs[f].sorted ? static_cast<row_index_t>(runs[f].begin + pos) : sorted_rows[f][pos];
+            };
+
+            std::vector<head_t> heap;
+            heap.reserve(runs.size());
+            for (std::size_t f = 0; f < runs.size(); ++f) {
+                if (runs[f].end > runs[f].begin) heap.push_back({ receive_ts[row_at(f, 0)], f, 0 });
+            }
+            std::make_heap(heap.begin(), heap.end(), later);
+
+            std::vector<row_index_t> order;
+            order.reserve(size());
+            while (!heap.empty()) {
+                std::pop_heap(heap.begin(), heap.end(), later);
+                auto& h = heap.back();
+                const auto& r = runs[h.file];
+                const std::size_t len = r.end - r.begin;
+                // пока голова файла не уступает следующему кандидату — копируем без перестройки кучи
+                const head_t* rival = heap.size() > 1 ? &heap.front() : nullptr;
+                do {
+                    order.push_back(row_at(h.file, h.pos));
+                    if (++h.pos == len) break;
+                    h.ts = receive_ts[row_at(h.file, h.pos)];
+                } while (!rival || !later(h, *rival));
+                if (h.pos == len) {
+                    heap.pop_back();
+                }
+                else {
+                    std::push_heap(heap.begin(), heap.end(), later);
+                }
+            }
+            apply_order(order, pool);
+        }
+
+    private:
+        /// Меньшие диапазоны time_order сортирует сравнением
+        static constexpr std::size_t small_sort_rows = 4096;
+
+        template <class T>
+        static void gather(std::vector<T>& column, const std::vector<row_index_t>& order, par::thread_pool& pool) {
+            std::vector<T> out(order.size());
+            const std::size_t n = order.size();
+            const std::size_t blocks = std::clamp<std::size_t>(n / par::radix_min_block, 1, pool.size());
+            pool.parallel_for(blocks, [&](std::size_t b) {
+                for (std::size_t i = n * b / blocks, e = n * (b + 1) / blocks; i < e; ++i) out[i] = column[order[i]];
+            });
+            column.swap(out);
+        }
+    };
+
+    using record_store = basic_record_store<double>;
+    using fixed_record_store = basic_record_store<std::int64_t>;
+
+}  // namespace csv
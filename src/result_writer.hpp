@@ -0,0 +1,302 @@
+﻿#pragma once
+/**
+ * \file result_writer.hpp
+ * \brief Форматирование и буферизованная запись median_result.csv
+ *
+ * Числа переводятся в текст через std::to_chars прямо в буфер вывода — без
+ * ostringstream и временных строк. Изменение медианы определяется сначала
+ * численно (тот же double / тот же int64 — строка не пишется), и только при
+ * изменении значения сравнивается текст с 8 знаками: разные double могут
+ * округляться до одинаковой строки, а в файл попадают только изменения текста.
+ * Буфер отдаётся в поток крупными блоками.
+ *
+ * Двоичный формат (median_result.bin) — для потребителей, которым не нужен
+ * разбор текста: заголовок binary_header, затем записи фиксированной длины
+ * из 8-байтовых little-endian полей в порядке колонок CSV — u64 receive_ts,
+ * медиана и статистики. Для double значения — f64 (нет значения — NaN), для
+ * фиксированной точки — i64 в единицах 1 / price_scale (нет значения — INT64_MIN).
+ * Записи — те же строки, что попали бы в CSV. Заголовок кратен 8 байтам, а при
+ * page_align — 4096: записи можно отобразить в память и читать как массив.
+ */
+
+#include <string>
+#include <string_view>
+#include <ostream>
+#include <charconv>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+#include <span>
+#include <bit>
+#include <limits>
+
+#include "csv_reader.hpp"
+
+namespace out {
+
+    /// Запас под текст цены: double в fixed с 8 знаками (до 309 цифр целой части)
+    inline constexpr std::size_t max_price_chars = 330;
+    /// Запас под целое без знака (receive_ts)
+    inline constexpr std::size_t max_u64_chars = 20;
+
+    /// Цена с 8 знаками после точки; возвращает указатель за последним символом
+    inline char* format_price(char* first, char* last, double v) {
+        return std::to_chars(first, last, v, std::chars_format::fixed, csv::price_fraction_digits).ptr;
+    }
+
+    /// Цена в фиксированной точке (csv::price_scale) с 8 знаками после точки
+    inline char* format_price(char* first, char* last, std::int64_t v) {
+        constexpr auto scale = static_cast<std::uint64_t>(csv::price_scale);
+        const bool neg = v < 0;
+        const auto u = neg ? 0 - static_cast<std::uint64_t>(v) : static_cast<std::uint64_t>(v);
+        char* p = first;
+        if (neg) *p++ = '-';
+        p = std::to_chars(p, last, u / scale).ptr;
+        *p++ = '.';
+        // дробная часть с ведущими нулями: пишем цифры справа налево
+        std::uint64_t frac = u % scale;
+        for (std::size_t i = csv::price_fraction_digits; i-- > 0;) {
+            p[i] = static_cast<char>('0' + frac % 10);
+            frac /= 10;
+        }
+        return p + csv::price_fraction_digits;
+    }
+
+    /**
+     * \brief Отслеживает последнюю записанную медиану.
+     *
+     * update(v) возвращает true, если текстовое представление изменилось;
+     * тогда text() — новый текст. Форматирование выполняется только когда
+     * изменилось само значение.
+     */
+    template <class Price>
+    class change_detector {
+    public:
+        bool update(Price v) {
+            if (_has_value && same_value(v, _value)) return false;
+            _value = v;
+            char buf[max_price_chars];
+            const auto len = static_cast<std::size_t>(format_price(buf, buf + sizeof(buf), v) - buf);
+            if (_has_value && len == _len && std::memcmp(buf, _text, len) == 0) return false;
+            std::memcpy(_text, buf, len);
+            _len = len;
+            _has_value = true;
+            return true;
+        }
+
+        std::string_view text() const noexcept { return { _text, _len }; }
+
+        /// Последнее значение, переданное в update()
+        Price value() const noexcept { return _value; }
+
+        /// Сохранение / восстановление состояния (архивы checkpoint.hpp)
+        template <class Archive>
+        void serialize_state(Archive& ar) {
+            std::string text(_text, _len);
+            ar & _value & _has_value & text;
+            if constexpr (Archive::is_loading) {
+                _len = std::min(text.size(), sizeof(_text));
+                std::memcpy(_text, text.data(), _len);
+            }
+        }
+
+    private:
+        static bool same_value(Price a, Price b) {
+            if constexpr (std::is_floating_point_v<Price>) {
+                // -0.0 и 0.0 печатаются по-разному, поэтому сравниваем побитово
+                return std::memcmp(&a, &b, sizeof(Price)) == 0;
+            }
+            else {
+                return a == b;
+            }
+        }
+
+    private:
+        Price _value{};
+        bool _has_value = false;
+        char _text[max_price_chars];
+        std::size_t _len = 0;
+    };
+
+    /**
+     * \brief Дописывает поле ";value" дополнительной статистики (quantile_stats.hpp).
+     *
+     * Значение форматируется как цена типа Price (для int64 — округляется до
+     * единицы фиксированной точки); NaN даёт пустое поле.
+     */
+    template <class Price>
+    void append_stat(std::string& out, double v) {
+        out += ';';
+        if (!std::isfinite(v)) return;
+        char buf[max_price_chars];
+        char* end = nullptr;
+        if constexpr (std::is_integral_v<Price>) {
+            end = format_price(buf, buf + sizeof(buf), static_cast<std::int64_t>(std::llround(v)));
+        }
+        else {
+            end = format_price(buf, buf + sizeof(buf), v);
+        }
+        out.append(buf, end);
+    }
+
+    /**
+     * \brief Дописывает строку результата "receive_ts;median<extra>\n" в конец буфера.
+     * \param extra уже отформатированные дополнительные поля (каждое с ';' впереди)
+     */
+    inline void append_row(std::string& out, std::uint64_t ts, std::string_view median, std::string_view extra = {}) {
+        const std::size_t pos = out.size();
+        out.resize(pos + max_u64_chars + 1 + median.size() + extra.size() + 1);
+        char* p = out.data() + pos;
+        p = std::to_chars(p, p + max_u64_chars, ts).ptr;
+        *p++ = ';';
+        std::memcpy(p, median.data(), median.size());
+        p += median.size();
+        if (!extra.empty()) {
+            std::memcpy(p, extra.data(), extra.size());
+            p += extra.size();
+        }
+        *p++ = '\n';
+        out.resize(static_cast<std::size_t>(p - out.data()));
+    }
+
+    /// Формат файла результата
+    enum class file_format { csv, binary };
+
+    /// Формат и раскладка файла результата (main.output_format, main.output_page_align)
+    struct result_format {
+        file_format file = file_format::csv;
+        bool page_align = false;  ///< binary: записи начинаются с границы 4 КБ
+
+        /// Имя файла результата: median_result<suffix>.csv или .bin
+        std::string file_name(std::string_view suffix = {}) const {
+            return "median_result" + std::string(suffix) + (file == file_format::binary ? ".bin" : ".csv");
+        }
+    };
+
+    /**
+     * \brief Раскладка заголовка двоичного файла результата (все поля little-endian).
+     *
+     * За фиксированной частью — имена колонок, каждое с завершающим '\0',
+     * затем нули до header_bytes.
+     */
+    struct binary_header {
+        static constexpr char magic[8] = { 'M', 'E', 'D', 'I', 'A', 'N', 'B', '1' };
+        static constexpr std::size_t magic_at = 0;         ///< char[8]
+        static constexpr std::size_t header_bytes_at = 8;  ///< u32: смещение первой записи
+        static constexpr std::size_t record_bytes_at = 12; ///< u32: длина записи (8 * число колонок)
+        static constexpr std::size_t columns_at = 16;      ///< u32: число колонок, включая receive_ts
+        static constexpr std::size_t price_kind_at = 20;   ///< u32: 0 — f64, 1 — i64 (фиксированная точка)
+        static constexpr std::size_t price_scale_at = 24;  ///< i64: масштаб i64 (csv::price_scale), для f64 — 1
+        static constexpr std::size_t names_at = 32;
+        static constexpr std::size_t page_bytes = 4096;
+    };
+
+    namespace detail {
+        template <class T>
+        char* put_le(char* p, T v) {
+            static_assert(sizeof(T) == 4 || sizeof(T) == 8);
+            using bits_t = std::conditional_t<sizeof(T) == 8, std::uint64_t, std::uint32_t>;
+            auto bits = std::bit_cast<bits_t>(v);
+            if constexpr (std::endian::native == std::endian::big) bits = std::byteswap(bits);
+            std::memcpy(p, &bits, sizeof(bits));
+            return p + sizeof(bits);
+        }
+    }  // namespace detail
+
+    /**
+     * \brief Заголовок двоичного файла результата с колонками receive_ts, price_median и stat_names.
+     * \tparam Price double (поля f64) или std::int64_t (поля i64, фиксированная точка)
+     */
+    template <class Price>
+    std::string make_binary_header(const std::vector<std::string>& stat_names, bool page_align) {
+        std::vector<std::string> names{ "receive_ts", "price_median" };
+        names.insert(names.end(), stat_names.begin(), stat_names.end());
+        std::size_t size = binary_header::names_at;
+        for (const auto& n : names) size += n.size() + 1;
+        const std::size_t align = page_align ? binary_header::page_bytes : 8;
+        size = (size + align - 1) / align * align;
+
+        std::string out(size, '\0');
+        char* p = out.data();
+        std::memcpy(p + binary_header::magic_at, binary_header::magic, sizeof(binary_header::magic));
+        detail::put_le(p + binary_header::header_bytes_at, static_cast<std::uint32_t>(size));
+        detail::put_le(p + binary_header::record_bytes_at, static_cast<std::uint32_t>(8 * names.size()));
+        detail::put_le(p + binary_header::columns_at, static_cast<std::uint32_t>(names.size()));
+        detail::put_le(p + binary_header::price_kind_at, static_cast<std::uint32_t>(std::is_integral_v<Price> ? 1 : 0));
+        detail::put_le(p + binary_header::price_scale_at, std::is_integral_v<Price> ? csv::price_scale : std::int64_t(1));
+        p += binary_header::names_at;
+        for (const auto& n : names) {
+            std::memcpy(p, n.data(), n.size());
+            p += n.size() + 1;
+        }
+        return out;
+    }
+
+    /**
+     * \brief Дописывает двоичную запись результата: receive_ts, медиана и статистики stats.
+     *
+     * Статистики приводятся к типу медианы (для int64 — округление до единицы
+     * фиксированной точки, как в append_stat); NaN — «нет значения».
+     */
+    template <class Price>
+    void append_binary_row(std::string& out, std::uint64_t ts, Price median, std::span<const double> stats = {}) {
+        const std::size_t pos = out.size();
+        out.resize(pos + 8 * (2 + stats.size()));
+        char* p = out.data() + pos;
+        p = detail::put_le(p, ts);
+        p = detail::put_le(p, median);
+        for (double v : stats) {
+            if constexpr (std::is_integral_v<Price>) {
+                p = detail::put_le(p, std::isfinite(v) ? static_cast<std::int64_t>(std::llround(v))
+                    : std::numeric_limits<std::int64_t>::min());
+            }
+            else {
+                p = detail::put_le(p, std::isfinite(v) ? v : std::numeric_limits<double>::quiet_NaN());
+            }
+        }
+    }
+
+    /**
+     * \brief Буфер вывода, сбрасываемый в поток блоками не меньше block_bytes.
+     *
+     * Строки дописываются в buffer(); maybe_flush() отдаёт буфер в поток,
+     * когда он заполнен, память буфера переиспользуется.
+     */
+    class block_writer {
+    public:
+        explicit block_writer(std::ostream& os, std::size_t block_bytes = std::size_t(1) << 20)
+            : _os(os), _block(block_bytes) {
+            _buf.reserve(_block + _block / 4);
+        }
+
+        std::string& buffer() noexcept { return _buf; }
+
+        void maybe_flush() {
+            if (_buf.size() >= _block) flush();
+        }
+
+        /// \return false при ошибке записи
+        bool flush() {
+            if (!_buf.empty()) {
+                _os.write(_buf.data(), static_cast<std::streamsize>(_buf.size()));
+                _written += _buf.size();
+                _buf.clear();
+            }
+            return static_cast<bool>(_os);
+        }
+
+        /// Сколько байт отдано в поток
+        std::uint64_t bytes_written() const noexcept { return _written; }
+
+    private:
+        std::ostream& _os;
+        std::size_t _block;
+        std::string _buf;
+        std::uint64_t _written = 0;
+    };
+
+}  // namespace out
@@ -0,0 +1,253 @@
+﻿#pragma once
+/**
+ * \file simd_scan.hpp
+ * \brief Векторный поиск разделителей и переводов строки в CSV
+ *
+ * Блок из 64 байт превращается в две битовые маски: позиции разделителя и '\n'.
+ * Реализация выбирается один раз при старте по возможностям процессора:
+ * AVX2 (2 x 32 байта), SSE2 (4 x 16 байт, есть на любом x86-64), NEON (AArch64)
+ * или скалярный цикл. block_cursor поверх масок отдаёт позиции границ полей,
+ * так что ненужные колонки пропускаются без побайтового сравнения.
+ */
+
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <bit>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CSV_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CSV_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+// GCC/Clang позволяют собрать AVX2-функцию без глобального -mavx2;
+// MSVC разрешает интринсики без флагов компиляции.
+#if defined(CSV_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define CSV_SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CSV_SIMD_TARGET_AVX2
+#endif
+
+namespace csv::simd {
+
+    /// Размер блока, который сканируется за один вызов
+    inline constexpr std::size_t block_size = 64;
+
+    /// Битовые маски блока: бит i установлен, если байт i — разделитель / '\n'
+    struct block_masks {
+        std::uint64_t delim;
+        std::uint64_t newline;
+    };
+
+    /// Сканирует ровно block_size байт начиная с p
+    using scan_fn = block_masks(*)(const char* p, char sep);
+
+    enum class isa { scalar, sse2, avx2, neon };
+
+    inline const char* isa_name(isa v) {
+        switch (v) {
+        case isa::sse2: return "sse2";
+        case isa::avx2: return "avx2";
+        case isa::neon: return "neon";
+        default: return "scalar";
+        }
+    }
+
+    inline block_masks scan_scalar(const char* p, char sep) {
+        block_masks m{ 0, 0 };
+        for (std::size_t i = 0; i < block_size; ++i) {
+            m.delim |= std::uint64_t(p[i] == sep) << i;
+            m.newline |= std::uint64_t(p[i] == '\n') << i;
+        }
+        return m;
+    }
+
+#if defined(CSV_SIMD_X86)
+    inline block_masks scan_sse2(const char* p, char sep) {
+        const __m128i vs = _mm_set1_epi8(sep);
+        const __m128i vn = _mm_set1_epi8('\n');
+        block_masks m{ 0, 0 };
+        for (int i = 0; i < 4; ++i) {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i * 16));
+            const auto d = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, vs)));
+            const auto n = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, vn)));
+            m.delim |= std::uint64_t(d) << (i * 16);
+            m.newline |= std::uint64_t(n) << (i * 16);
+        }
+        return m;
+    }
+
+    CSV_SIMD_TARGET_AVX2 inline block_masks scan_avx2(const char* p, char sep) {
+        const __m256i vs = _mm256_set1_epi8(sep);
+        const __m256i vn = _mm256_set1_epi8('\n');
+        const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+        const auto d0 = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, vs)));
+        const auto d1 = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, vs)));
+        const auto n0 = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, vn)));
+        const auto n1 = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, vn)));
+        return { d0 | (std::uint64_t(d1) << 32), n0 | (std::uint64_t(n1) << 32) };
+    }
+
+    inline bool cpu_has_avx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+        int regs[4] = { 0, 0, 0, 0 };
+        __cpuid(regs, 0);
+        if (regs[0] < 7) return false;
+        __cpuid(regs, 1);
+        const bool osxsave = (regs[2] & (1 << 27)) != 0;
+        const bool avx = (regs[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx) return false;
+        // ОС должна сохранять регистры YMM при переключении контекста
+        if ((_xgetbv(0) & 0x6) != 0x6) return false;
+        __cpuidex(regs, 7, 0);
+        return (regs[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+#if defined(CSV_SIMD_NEON)
+    inline std::uint64_t neon_bitmask(uint8x16_t c0, uint8x16_t c1, uint8x16_t c2, uint8x16_t c3) {
+        const uint8x16_t bits = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80,
+                                  0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80 };
+        uint8x16_t s0 = vpaddq_u8(vandq_u8(c0, bits), vandq_u8(c1, bits));
+        uint8x16_t s1 = vpaddq_u8(vandq_u8(c2, bits), vandq_u8(c3, bits));
+        s0 = vpaddq_u8(s0, s1);
+        s0 = vpaddq_u8(s0, s0);
+        return vgetq_lane_u64(vreinterpretq_u64_u8(s0), 0);
+    }
+
+    inline block_masks scan_neon(const char* p, char sep) {
+        const auto* u = reinterpret_cast<const std::uint8_t*>(p);
+        const uint8x16_t v0 = vld1q_u8(u), v1 = vld1q_u8(u + 16), v2 = vld1q_u8(u + 32), v3 = vld1q_u8(u + 48);
+        const uint8x16_t vs = vdupq_n_u8(static_cast<std::uint8_t>(sep));
+        const uint8x16_t vn = vdupq_n_u8(static_cast<std::uint8_t>('\n'));
+        return {
+            neon_bitmask(vceqq_u8(v0, vs), vceqq_u8(v1, vs), vceqq_u8(v2, vs), vceqq_u8(v3, vs)),
+            neon_bitmask(vceqq_u8(v0, vn), vceqq_u8(v1, vn), vceqq_u8(v2, vn), vceqq_u8(v3, vn)) };
+    }
+#endif
+
+    /// Лучшая реализация, доступная на текущем процессоре
+    inline isa detect_isa() {
+#if defined(CSV_SIMD_X86)
+        return cpu_has_avx2() ? isa::avx2 : isa::sse2;
+#elif defined(CSV_SIMD_NEON)
+        return isa::neon;
+#else
+        return isa::scalar;
+#endif
+    }
+
+    /// Проверяет, можно ли использовать реализацию v на этой машине
+    inline bool isa_supported(isa v) {
+        switch (v) {
+        case isa::scalar: return true;
+#if defined(CSV_SIMD_X86)
+        case isa::sse2: return true;
+        case isa::avx2: return cpu_has_avx2();
+#elif defined(CSV_SIMD_NEON)
+        case isa::neon: return true;
+#endif
+        default: return false;
+        }
+    }
+
+    inline scan_fn scanner_for(isa v) {
+        switch (v) {
+#if defined(CSV_SIMD_X86)
+        case isa::sse2: return &scan_sse2;
+        case isa::avx2: return &scan_avx2;
+#elif defined(CSV_SIMD_NEON)
+        case isa::neon: return &scan_neon;
+#endif
+        default: return &scan_scalar;
+        }
+    }
+
+    namespace detail {
+        struct active_scanner_t {
+            isa kind;
+            scan_fn fn;
+        };
+
+        inline active_scanner_t& active_scanner() {
+            static active_scanner_t s{ detect_isa(), scanner_for(detect_isa()) };
+            return s;
+        }
+    }  // namespace detail
+
+    /// Реализация, которой пользуется block_cursor
+    inline isa active_isa() { return detail::active_scanner().kind; }
+
+    /**
+     * \brief Принудительно выбрать реализацию (для бенчмарков и отладки).
+     * \return false, если реализация не поддерживается процессором
+     */
+    inline bool force_isa(isa v) {
+        if (!isa_supported(v)) return false;
+        detail::active_scanner() = { v, scanner_for(v) };
+        return true;
+    }
+
+    /**
+     * \brief Курсор по буферу, отдающий позиции разделителей и '\n'.
+     *
+     * Маски вычисляются лениво по блокам; последний неполный блок копируется
+     * в буфер, дополненный нулями, чтобы не читать за границу данных.
+     * Если символ не найден, возвращается размер буфера.
+     */
+    class block_cursor {
+    public:
+        block_cursor(std::string_view data, char sep)
+            : _data(data), _sep(sep), _scan(detail::active_scanner().fn) {
+        }
+
+        /// Позиция ближайшего разделителя или '\n', начиная с from
+        std::size_t next_any(std::size_t from) { return next(from, true); }
+
+        /// Позиция ближайшего '\n', начиная с from (разделители пропускаются)
+        std::size_t next_newline(std::size_t from) { return next(from, false); }
+
+    private:
+        std::size_t next(std::size_t from, bool any) {
+            while (from < _data.size()) {
+                const std::size_t base = from & ~(block_size - 1);
+                if (base != _base) load(base);
+                std::uint64_t m = any ? (_masks.delim | _masks.newline) : _masks.newline;
+                m &= ~std::uint64_t(0) << (from - base);
+                if (m != 0) return base + static_cast<std::size_t>(std::countr_zero(m));
+                from = base + block_size;
+            }
+            return _data.size();
+        }
+
+        void load(std::size_t base) {
+            _base = base;
+            if (base + block_size <= _data.size()) {
+                _masks = _scan(_data.data() + base, _sep);
+                return;
+            }
+            alignas(64) char tail[block_size] = {};
+            std::memcpy(tail, _data.data() + base, _data.size() - base);
+            _masks = _scan(tail, _sep);
+        }
+
+    private:
+        std::string_view _data;
+        char _sep;
+        scan_fn _scan;
+        std::size_t _base = ~std::size_t(0);
+        block_masks _masks{ 0, 0 };
+    };
+
+}  // namespace csv::simd
@@ -0,0 +1,452 @@
+﻿#pragma once
+/**
+ * \file streaming.hpp
+ * \brief Потоковый конвейер с ограниченной памятью
+ *
+ * Чтение → слияние → расчёт → запись соединены очередями ограниченной ёмкости:
+ *  - потоки чтения разбирают файлы порциями (не больше queue_depth порций на файл);
+ *  - поток слияния объединяет порции файлов кучей по (receive_ts, file_id);
+ *  - потребитель (расчёт медианы) забирает слитые порции через merged_reader::next;
+ *  - async_writer пишет готовые блоки текста в отдельном потоке.
+ * Входные файлы должны быть упорядочены по receive_ts — нарушение порядка
+ * сообщается как ошибка с файлом и строкой. Сжатые файлы (.csv.gz, .csv.zst)
+ * распаковываются по блоку за раз тем потоком чтения, который разбирает файл.
+ */
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <filesystem>
+#include <optional>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <ostream>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+#include "csv_reader.hpp"
+#include "record_store.hpp"
+
+namespace stream {
+
+    /// Очередь фиксированной ёмкости между стадиями конвейера
+    template <class T>
+    class bounded_queue {
+    public:
+        explicit bounded_queue(std::size_t capacity) : _capacity(std::max<std::size_t>(capacity, 1)) {}
+
+        /// Блокируется, пока очередь полна; false — очередь закрыта
+        bool push(T value) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _not_full.wait(lock, [this] { return _closed || _items.size() < _capacity; });
+            if (_closed) return false;
+            _items.push_back(std::move(value));
+            _not_empty.notify_one();
+            return true;
+        }
+
+        /// Блокируется, пока очередь пуста; false — очередь закрыта и пуста
+        bool pop(T& out) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _not_empty.wait(lock, [this] { return _closed || !_items.empty(); });
+            if (_items.empty()) return false;
+            out = std::move(_items.front());
+            _items.pop_front();
+            _not_full.notify_one();
+            return true;
+        }
+
+        /// Закрыть: push больше не принимается, pop дочитывает остаток
+        void close() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+            _not_full.notify_all();
+            _not_empty.notify_all();
+        }
+
+    private:
+        std::size_t _capacity;
+        std::deque<T> _items;
+        std::mutex _mutex;
+        std::condition_variable _not_full;
+        std::condition_variable _not_empty;
+        bool _closed = false;
+    };
+
+    /// Запись блоков текста в поток вывода из отдельного потока
+    class async_writer {
+    public:
+        explicit async_writer(std::ostream& os, std::size_t depth = 8)
+            : _os(os), _queue(depth), _thread([this] { loop(); }) {
+        }
+
+        ~async_writer() { finish(); }
+
+        async_writer(const async_writer&) = delete;
+        async_writer& operator=(const async_writer&) = delete;
+
+        void write(std::string&& block) {
+            if (!block.empty()) _queue.push(std::move(block));
+        }
+
+        /// Дождаться записи всех блоков; false — ошибка потока вывода
+        bool finish() {
+            if (_thread.joinable()) {
+                _queue.close();
+                _thread.join();
+            }
+            return !_failed;
+        }
+
+    private:
+        void loop() {
+            std::string block;
+            while (_queue.pop(block)) {
+                if (!_failed) {
+                    _os.write(block.data(), static_cast<std::streamsize>(block.size()));
+                    _os.flush();
+                    _failed = !_os.good();
+                }
+            }
+        }
+
+    private:
+        std::ostream& _os;
+        bounded_queue<std::string> _queue;
+        bool _failed = false;
+        std::thread _thread;
+    };
+
+    /// Параметры потокового чтения
+    struct stream_options {
+        std::size_t threads = 1;                          ///< потоков разбора
+        std::size_t queue_depth = 2;                      ///< готовых порций на файл
+        std::size_t memory_budget = std::size_t(256) << 20;  ///< на все порции в очередях
+        std::size_t min_batch_rows = 1024;
+        std::size_t max_batch_rows = 65536;
+        csv::column_request columns;                      ///< имена колонок и необязательные колонки (quantity)
+        std::size_t read_ahead_bytes = csv::default_read_ahead_bytes;  ///< окно упреждающего чтения на файл; 0 — выключено
+        bool skip_invalid = false;                        ///< пропускать неверные строки (см. merged_reader::skipped)
+        std::uint64_t max_errors = 0;                     ///< при skip_invalid: предел пропущенных строк; 0 — без предела
+    };
+
+    /**
+     * \brief Слитый по receive_ts поток записей из набора упорядоченных файлов.
+     *
+     * Порядок записей тот же, что у basic_record_store::sort_by_time.
+     * Первая ошибка (разбор, нарушение порядка) сообщается в порядке слияния,
+     * поэтому не зависит от числа потоков.
+     */
+    template <class Price>
+    class merged_reader {
+    public:
+        using batch_t = csv::basic_record_store<Price>;
+
+        merged_reader() = default;
+        ~merged_reader() { stop(); }
+
+        merged_reader(const merged_reader&) = delete;
+        merged_reader& operator=(const merged_reader&) = delete;
+
+        /**
+         * \brief Открывает файлы, проверяет заголовки и запускает потоки чтения и слияния.
+         * \param paths файлы в порядке file_id
+         * \return std::nullopt при успехе или строка с описанием ошибки
+         */
+        std::optional<std::string> open(const std::vector<std::filesystem::path>& paths,
+            const stream_options& options = {}) {
+            stop();
+            _options = options;
+            _error.reset();
+            _done_files = 0;
+            _skipped_total = 0;
+            _files.clear();
+            _files.resize(paths.size());
+            for (std::size_t i = 0; i < paths.size(); ++i) {
+                auto& f = _files[i];
+                f.path = paths[i];
+                if (csv::codec::compression_of(paths[i]) != csv::codec::compression::none) {
+                    f.packed = std::make_unique<csv::codec::compressed_reader>();
+                    f.packed->set_read_ahead(_options.read_ahead_bytes);
+                    if (!csv::open_compressed(paths[i], *f.packed, f.input, f.block, _options.columns)) {
+                        return f.input.error;
+                    }
+                    f.pos = f.input.body_begin;
+                    if (f.pos >= f.block.size() && !f.block.empty()) {
+                        if (auto err = f.packed->next(f.block)) return err;
+                        f.pos = 0;
+                    }
+                    f.done = f.block.empty();
+                }
+                else {
+                    if (!csv::open_input(paths[i], f.input, _options.columns)) return f.input.error;
+                    f.pos = f.input.body_begin;
+                    f.ahead = csv::read_ahead(_options.read_ahead_bytes);
+                    f.ahead.advance(f.input.file, f.pos);
+                    f.done = f.pos >= f.input.file.size();
+                }
+                if (f.done) ++_done_files;
+            }
+            const std::size_t per_file = _options.memory_budget /
+                (std::max<std::size_t>(_files.size(), 1) * _options.queue_depth * row_bytes);
+            _batch_rows = std::clamp(per_file, _options.min_batch_rows, _options.max_batch_rows);
+
+            _out = std::make_unique<bounded_queue<batch_t>>(_options.queue_depth);
+            _stopping = false;
+            const std::size_t readers = std::clamp<std::size_t>(_options.threads, 1, std::max<std::size_t>(_files.size(), 1));
+            for (std::size_t i = 0; i < readers; ++i) {
+                _readers.emplace_back([this] { reader_loop(); });
+            }
+            _merger = std::thread([this] { merge_loop(); });
+            return std::nullopt;
+        }
+
+        /// Строк в одной порции чтения
+        std::size_t batch_rows() const noexcept { return _batch_rows; }
+
+        /// Следующая слитая порция; false — данные закончились (или ошибка, см. error())
+        bool next(batch_t& out) { return _out && _out->pop(out); }
+
+        /// Ошибка чтения или порядка; достоверна после того, как next вернул false
+        const std::optional<std::string>& error() const noexcept { return _error; }
+
+        /**
+         * \brief Пропущенные неверные строки (stream_options::skip_invalid) по файлам в порядке file_id.
+         *
+         * Достоверно после того, как next вернул false. Предел max_errors общий для всех
+         * файлов, поэтому при его превышении момент остановки зависит от темпа чтения файлов.
+         */
+        csv::row_error_log skipped() const {
+            csv::row_error_log all;
+            for (const auto& f : _files) all.append(f.skipped);
+            return all;
+        }
+
+    private:
+        static constexpr std::size_t row_bytes = sizeof(std::uint64_t) + sizeof(Price) +
+            sizeof(csv::file_id_t) + sizeof(csv::line_no_t);
+
+        struct file_state {
+            std::filesystem::path path;
+            csv::mapped_input input;
+            std::unique_ptr<csv::codec::compressed_reader> packed;  ///< для сжатого файла (input.file не используется)
+            std::string_view block;          ///< текущий распакованный блок сжатого файла
+            csv::read_ahead ahead{ 0 };      ///< упреждающее чтение несжатого файла
+            csv::row_error_log skipped;      ///< пишет только поток, разбирающий файл (busy)
+            std::size_t pos = 0;             ///< следующая строка для разбора (в блоке — для сжатого файла)
+            std::uint64_t line_no = 1;       ///< последняя разобранная строка
+            std::uint64_t last_ts = 0;
+            bool has_rows = false;
+            std::deque<batch_t> ready;
+            bool busy = false;
+            bool done = false;
+            std::optional<std::string> error;  ///< выдаётся после всех порций из ready
+        };
+
+        void stop() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stopping = true;
+            }
+            _readers_cv.notify_all();
+            _merger_cv.notify_all();
+            if (_out) _out->close();
+            for (auto& t : _readers) t.join();
+            _readers.clear();
+            if (_merger.joinable()) _merger.join();
+        }
+
+        /// Файл, которому нужна следующая порция: самый «голодный» из свободных
+        std::size_t pick_file() const {
+            std::size_t best = _files.size();
+            for (std::size_t i = 0; i < _files.size(); ++i) {
+                const auto& f = _files[i];
+                if (f.busy || f.done || f.ready.size() >= _options.queue_depth) continue;
+                if (best == _files.size() || f.ready.size() < _files[best].ready.size()) best = i;
+                if (f.ready.empty()) break;
+            }
+            return best;
+        }
+
+        void reader_loop() {
+            for (;;) {
+                std::size_t i = 0;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _readers_cv.wait(lock, [&] {
+                        if (_stopping || _done_files == _files.size()) return true;
+                        i = pick_file();
+                        return i < _files.size();
+                    });
+                    if (_stopping || _done_files == _files.size()) return;
+                    _files[i].busy = true;
+                }
+                auto& f = _files[i];
+                batch_t batch;
+                batch.reserve(_batch_rows);
+                const auto data = f.packed ? f.block : f.input.file.view();
+                const std::uint64_t skipped_before = f.skipped.count;
+                const auto st = csv::parse_rows(data, f.pos, data.size(), f.input.proj,
+                    static_cast<csv::file_id_t>(i), f.line_no, batch, _batch_rows,
+                    _options.skip_invalid ? &f.skipped : nullptr);
+
+                std::optional<std::string> err;
+                if (st.error != csv::row_error::none) {
+                    err = csv::describe_row_error(st.error, f.path.string(), st.error_line, _options.columns);
+                }
+                // нарушение порядка: отдаём строки до него и останавливаем файл
+                std::size_t bad = batch.size();
+                if (!batch.empty() && f.has_rows && batch.receive_ts[0] < f.last_ts) {
+                    bad = 0;
+                }
+                else if (!st.sorted) {
+                    for (std::size_t r = 1; r < batch.size(); ++r) {
+                        if (batch.receive_ts[r] < batch.receive_ts[r - 1]) {
+                            bad = r;
+                            break;
+                        }
+                    }
+                }
+                if (bad < batch.size()) {
+                    err = std::string("Файл не упорядочен по receive_ts (потоковый режим требует упорядоченных файлов): ") +
+                        f.path.string() + " на строке " + std::to_string(batch.line_no[bad]);
+                    batch.truncate(bad);
+                }
+                // блок сжатого файла разобран — распаковать следующий
+                std::size_t next_pos = st.next;
+                bool at_end = next_pos >= data.size();
+                if (f.packed) {
+                    if (at_end && !err) {
+                        err = f.packed->next(f.block);
+                        next_pos = 0;
+                        at_end = f.block.empty();
+                    }
+                }
+                else {
+                    f.input.file.discard_before(st.next);
+                    f.ahead.advance(f.input.file, st.next);
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    _skipped_total += f.skipped.count - skipped_before;
+                    if (!err && f.skipped.count != skipped_before && _options.max_errors != 0
+                        && _skipped_total > _options.max_errors) {
+                        const auto& first = f.skipped.samples.front();
+                        err = "Неверных строк больше предела max_errors (" + std::to_string(_options.max_errors)
+                            + "), первая в этом файле: "
+                            + csv::describe_row_error(first.error, f.path.string(), first.line, _options.columns);
+                    }
+                    f.busy = false;
+                    f.pos = next_pos;
+                    f.line_no += st.lines;
+                    if (!batch.empty()) {
+                        f.has_rows = true;
+                        f.last_ts = batch.receive_ts.back();
+                        f.ready.push_back(std::move(batch));
+                    }
+                    if (err || at_end) {
+                        f.error = std::move(err);
+                        f.done = true;
+                        ++_done_files;
+                    }
+                }
+                _merger_cv.notify_one();
+                _readers_cv.notify_all();
+            }
+        }
+
+        /// Ждёт следующую порцию файла; false — файл закончился или ошибка (в _error)
+        bool fetch(std::size_t i, batch_t& out) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            auto& f = _files[i];
+            _merger_cv.wait(lock, [&] { return _stopping || !f.ready.empty() || f.done; });
+            if (_stopping) return false;
+            if (!f.ready.empty()) {
+                out = std::move(f.ready.front());
+                f.ready.pop_front();
+                lock.unlock();
+                _readers_cv.notify_all();
+                return true;
+            }
+            if (f.error && !_error) _error = f.error;
+            return false;
+        }
+
+        void merge_loop() {
+            struct head_t {
+                std::uint64_t ts;
+                std::size_t file;
+            };
+            const auto later = [](const head_t& a, const head_t& b) {
+                if (a.ts != b.ts) return a.ts > b.ts;
+                return a.file > b.file;
+            };
+
+            std::vector<batch_t> current(_files.size());
+            std::vector<std::size_t> cursor(_files.size(), 0);
+            std::vector<head_t> heap;
+            for (std::size_t i = 0; i < _files.size() && !_error; ++i) {
+                if (fetch(i, current[i])) heap.push_back({ current[i].receive_ts[0], i });
+            }
+            std::make_heap(heap.begin(), heap.end(), later);
+
+            batch_t out;
+            out.reserve(_batch_rows);
+            while (!heap.empty() && !_error) {
+                std::pop_heap(heap.begin(), heap.end(), later);
+                auto& h = heap.back();
+                const head_t* rival = heap.size() > 1 ? &heap.front() : nullptr;
+                auto& b = current[h.file];
+                auto& c = cursor[h.file];
+                bool exhausted = false;
+                // копируем из файла, пока он не уступит следующему кандидату
+                for (;;) {
+                    out.copy_row_from(b, c);
+                    if (out.size() >= _batch_rows) {
+                        if (!_out->push(std::move(out))) return;
+                        out = batch_t{};
+                        out.reserve(_batch_rows);
+                    }
+                    if (++c == b.size()) {
+                        c = 0;
+                        if (!fetch(h.file, b)) {
+                            exhausted = true;
+                            break;
+                        }
+                    }
+                    h.ts = b.receive_ts[c];
+                    if (rival && later(h, *rival)) break;
+                }
+                if (exhausted) {
+                    heap.pop_back();
+                }
+                else {
+                    std::push_heap(heap.begin(), heap.end(), later);
+                }
+            }
+            if (!out.empty()) _out->push(std::move(out));
+            _out->close();
+        }
+
+    private:
+        stream_options _options;
+        std::vector<file_state> _files;
+        std::size_t _done_files = 0;
+        std::size_t _batch_rows = 0;
+        std::uint64_t _skipped_total = 0;  ///< пропущено строк во всех файлах (под _mutex)
+        std::mutex _mutex;
+        std::condition_variable _readers_cv;
+        std::condition_variable _merger_cv;
+        bool _stopping = false;
+        std::optional<std::string> _error;
+        std::unique_ptr<bounded_queue<batch_t>> _out;
+        std::vector<std::thread> _readers;
+        std::thread _merger;
+    };
+
+}  // namespace stream
@@ -0,0 +1,139 @@
+﻿#pragma once
+/**
+ * \file thread_pool.hpp
+ * \brief Простой пул потоков для параллельных циклов
+ *
+ * Потоки создаются один раз и переиспользуются между этапами (чтение, сортировка).
+ * parallel_for раздаёт индексы задач через атомарный счётчик; вызывающий поток
+ * тоже участвует в работе. Пул из одного потока выполняет задачи синхронно.
+ */
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+
+namespace par {
+
+    /// Число потоков по умолчанию: по числу ядер (минимум 1)
+    inline std::size_t default_thread_count() {
+        return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    class thread_pool {
+    public:
+        /// \param threads общее число потоков с учётом вызывающего; 0 — по числу ядер
+        explicit thread_pool(std::size_t threads = 0) {
+            const std::size_t n = threads == 0 ? default_thread_count() : threads;
+            _workers.reserve(n - 1);
+            for (std::size_t i = 1; i < n; ++i) {
+                _workers.emplace_back([this] { worker_loop(); });
+            }
+        }
+
+        ~thread_pool() {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _stop = true;
+            }
+            _wake.notify_all();
+            for (auto& t : _workers) t.join();
+        }
+
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        /// Число потоков, включая вызывающий
+        std::size_t size() const noexcept { return _workers.size() + 1; }
+
+        /**
+         * \brief Выполняет fn(i) для всех i из [0, n) и ждёт завершения.
+         *
+         * Порядок выполнения задач не определён. Если задача бросила исключение,
+         * оставшиеся задачи не запускаются, а первое исключение пробрасывается.
+         * Вложенные вызовы из задач не поддерживаются.
+         */
+        void parallel_for(std::size_t n, const std::function<void(std::size_t)>& fn) {
+            if (n == 0) return;
+            if (_workers.empty() || n == 1) {
+                for (std::size_t i = 0; i < n; ++i) fn(i);
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _job = &fn;
+                _job_size = n;
+                _next.store(0, std::memory_order_relaxed);
+                _active = _workers.size();
+                _error = nullptr;
+                ++_generation;
+            }
+            _wake.notify_all();
+
+            run_tasks(fn, n);
+
+            std::unique_lock<std::mutex> lock(_mutex);
+            _done.wait(lock, [this] { return _active == 0; });
+            _job = nullptr;
+            if (_error) std::rethrow_exception(std::exchange(_error, nullptr));
+        }
+
+    private:
+        void run_tasks(const std::function<void(std::size_t)>& fn, std::size_t n) {
+            for (;;) {
+                const std::size_t i = _next.fetch_add(1, std::memory_order_relaxed);
+                if (i >= n) break;
+                try {
+                    fn(i);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (!_error) _error = std::current_exception();
+                    _next.store(n, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void worker_loop() {
+            std::uint64_t seen = 0;
+            for (;;) {
+                const std::function<void(std::size_t)>* job = nullptr;
+                std::size_t n = 0;
+                {
+                    std::unique_lock<std::mutex> lock(_mutex);
+                    _wake.wait(lock, [&] { return _stop || _generation != seen; });
+                    if (_stop) return;
+                    seen = _generation;
+                    job = _job;
+                    n = _job_size;
+                }
+                run_tasks(*job, n);
+                {
+                    std::lock_guard<std::mutex> lock(_mutex);
+                    if (--_active == 0) _done.notify_one();
+                }
+            }
+        }
+
+    private:
+        std::vector<std::thread> _workers;
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::condition_variable _done;
+        const std::function<void(std::size_t)>* _job = nullptr;
+        std::size_t _job_size = 0;
+        std::atomic<std::size_t> _next{ 0 };
+        std::size_t _active = 0;
+        std::uint64_t _generation = 0;
+        std::exception_ptr _error;
+        bool _stop = false;
+    };
+
+}  // namespace par
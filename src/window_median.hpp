@@ -0,0 +1,229 @@
+﻿#pragma once
+/**
+ * \file window_median.hpp
+ * \brief Медиана в скользящем окне по receive_ts или по числу тиков.
+ *
+ * Значения хранятся в двух кучах (как в exact_median.hpp) с отложенным удалением:
+ * вытесненное из окна значение только помечается в таблице _delayed и физически
+ * покидает кучу, когда оказывается на вершине. Живые размеры куч ведутся отдельно,
+ * поэтому вставка и вытеснение — O(log n) амортизированно, медиана — O(1).
+ * Если помеченных значений становится больше живых, кучи перестраиваются за O(n),
+ * так что память ограничена размером окна.
+ *
+ * Окно по времени охватывает (ts - window_us, ts], по тикам — последние window_ticks значений.
+ */
+
+#include <vector>
+#include <span>
+#include <deque>
+#include <optional>
+#include <unordered_map>
+#include <algorithm>
+#include <functional>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+namespace median {
+
+    /// Размер окна: по времени (микросекунды receive_ts) или по числу значений
+    struct window_spec {
+        std::uint64_t window_us = 0;     ///< 0 — не ограничивать по времени
+        std::size_t window_ticks = 0;    ///< 0 — не ограничивать по числу
+    };
+
+    template <class T>
+    class window_median_calculator {
+        static_assert(std::is_arithmetic_v<T>, "median value type must be arithmetic");
+
+    public:
+        using value_type = T;
+
+        explicit window_median_calculator(window_spec spec) : _spec(spec) {}
+
+        /// Добавить значение с меткой времени; ts не должен убывать
+        void add(std::uint64_t ts, T v) {
+            insert(v);
+            _window.emplace_back(ts, v);
+            if (_spec.window_ticks != 0) {
+                while (_window.size() > _spec.window_ticks) evict_front();
+            }
+            if (_spec.window_us != 0) {
+                while (_window.front().first + _spec.window_us <= ts) evict_front();
+            }
+            if (_delayed_count > size() + compact_slack) compact();
+        }
+
+        /// То же, что add() для каждой пары (ts[i], values[i]); размеры ts и values равны
+        void add_batch(std::span<const std::uint64_t> ts, std::span<const T> values) {
+            for (std::size_t i = 0; i < values.size(); ++i) add(ts[i], values[i]);
+        }
+
+        /**
+         * \brief add_batch, сообщающий медиану после каждого значения.
+         * \param on_median вызывается как on_median(i, медиана после values[i])
+         */
+        template <class OnMedian>
+        void add_batch_and_emit(std::span<const std::uint64_t> ts, std::span<const T> values, OnMedian&& on_median) {
+            for (std::size_t i = 0; i < values.size(); ++i) {
+                add(ts[i], values[i]);
+                on_median(i, top_median());
+            }
+        }
+
+        std::optional<T> median() const {
+            if (_low_size == 0) return std::nullopt;
+            return top_median();
+        }
+
+        /// Число значений в окне
+        std::size_t size() const noexcept { return _low_size + _high_size; }
+
+        void reset() {
+            _window.clear();
+            _low.clear();
+            _high.clear();
+            _delayed.clear();
+            _low_size = _high_size = _delayed_count = 0;
+        }
+
+        /**
+         * \brief Сохранение / восстановление состояния (архивы checkpoint.hpp).
+         *
+         * Сохраняется только содержимое окна; кучи при загрузке строятся заново —
+         * медиана зависит лишь от набора значений в окне.
+         */
+        template <class Archive>
+        void serialize_state(Archive& ar) {
+            if constexpr (Archive::is_loading) {
+                std::deque<std::pair<std::uint64_t, T>> window;
+                ar & window;
+                reset();
+                for (const auto& [ts, v] : window) {
+                    insert(v);
+                    _window.emplace_back(ts, v);
+                }
+            }
+            else {
+                ar & _window;
+            }
+        }
+
+    private:
+        static constexpr std::size_t compact_slack = 1024;
+
+        using max_cmp = std::less<T>;
+        using min_cmp = std::greater<T>;
+
+        /// Медиана по вершинам куч; окно не пусто
+        T top_median() const {
+            if (_low_size > _high_size) return _low.front();
+            const T lo = _low.front();
+            const T hi = _high.front();
+            if constexpr (std::is_integral_v<T>) {
+                return lo + (hi - lo) / 2;  // без переполнения, округление вниз
+            }
+            else {
+                return (lo + hi) / 2.0;
+            }
+        }
+
+        void insert(T v) {
+            if (_low_size == 0 || v <= _low.front()) {
+                _low.push_back(v);
+                std::push_heap(_low.begin(), _low.end(), max_cmp{});
+                ++_low_size;
+            }
+            else {
+                _high.push_back(v);
+                std::push_heap(_high.begin(), _high.end(), min_cmp{});
+                ++_high_size;
+            }
+            rebalance();
+        }
+
+        void evict_front() {
+            const T v = _window.front().second;
+            _window.pop_front();
+            ++_delayed[v];
+            ++_delayed_count;
+            // вершины куч всегда живые, поэтому сторону можно определить сравнением
+            if (_low_size != 0 && v <= _low.front()) {
+                --_low_size;
+                prune(_low, max_cmp{});
+            }
+            else {
+                --_high_size;
+                prune(_high, min_cmp{});
+            }
+            rebalance();
+        }
+
+        void rebalance() {
+            // инвариант: low_size == high_size или low_size == high_size + 1
+            if (_low_size > _high_size + 1) {
+                move_top(_low, max_cmp{}, _high, min_cmp{});
+                --_low_size;
+                ++_high_size;
+                prune(_low, max_cmp{});
+            }
+            else if (_high_size > _low_size) {
+                move_top(_high, min_cmp{}, _low, max_cmp{});
+                --_high_size;
+                ++_low_size;
+                prune(_high, min_cmp{});
+            }
+        }
+
+        template <class FromCmp, class ToCmp>
+        static void move_top(std::vector<T>& from, FromCmp from_cmp, std::vector<T>& to, ToCmp to_cmp) {
+            std::pop_heap(from.begin(), from.end(), from_cmp);
+            to.push_back(from.back());
+            from.pop_back();
+            std::push_heap(to.begin(), to.end(), to_cmp);
+        }
+
+        /// Снимает с вершины кучи значения, помеченные на удаление
+        template <class Cmp>
+        void prune(std::vector<T>& heap, Cmp cmp) {
+            while (!heap.empty()) {
+                auto it = _delayed.find(heap.front());
+                if (it == _delayed.end()) return;
+                if (--it->second == 0) _delayed.erase(it);
+                --_delayed_count;
+                std::pop_heap(heap.begin(), heap.end(), cmp);
+                heap.pop_back();
+            }
+        }
+
+        /// Физически удаляет все помеченные значения и перестраивает кучи
+        void compact() {
+            const auto drop_delayed = [this](std::vector<T>& heap) {
+                std::erase_if(heap, [this](T v) {
+                    auto it = _delayed.find(v);
+                    if (it == _delayed.end()) return false;
+                    if (--it->second == 0) _delayed.erase(it);
+                    return true;
+                });
+            };
+            drop_delayed(_low);
+            drop_delayed(_high);
+            std::make_heap(_low.begin(), _low.end(), max_cmp{});
+            std::make_heap(_high.begin(), _high.end(), min_cmp{});
+            _delayed.clear();
+            _delayed_count = 0;
+        }
+
+    private:
+        window_spec _spec;
+        std::deque<std::pair<std::uint64_t, T>> _window;  ///< значения окна в порядке поступления
+        std::vector<T> _low;                              ///< max-куча нижней половины
+        std::vector<T> _high;                             ///< min-куча верхней половины
+        std::unordered_map<T, std::size_t> _delayed;      ///< значение -> сколько копий ждут удаления
+        std::size_t _low_size = 0;
+        std::size_t _high_size = 0;
+        std::size_t _delayed_count = 0;
+    };
+
+}  // namespace median